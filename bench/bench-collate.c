@@ -0,0 +1,188 @@
+/***************************************************************************
+ *            bench-collate.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "verve-completion.h"
+#include "verve-env-private.h"
+
+
+
+/* Number of times every sort is repeated, the fastest run is reported */
+#define BENCH_N_RUNS 3
+
+
+
+static gint     bench_collate_compare_names  (gconstpointer  a,
+                                              gconstpointer  b);
+static void     bench_collate_loaded         (VerveEnv      *env,
+                                              gpointer       user_data);
+static gdouble  bench_collate_sort_names     (GPtrArray     *names);
+static gdouble  bench_collate_add_names      (GPtrArray     *names,
+                                              guint         *n_added);
+
+
+
+static gint
+bench_collate_compare_names (gconstpointer a,
+                             gconstpointer b)
+{
+  /* Normalize and collate both names on every comparison */
+  return g_utf8_collate (*(const gchar **) a, *(const gchar **) b);
+}
+
+
+
+static void
+bench_collate_loaded (VerveEnv *env,
+                      gpointer  user_data)
+{
+  g_main_loop_quit (user_data);
+}
+
+
+
+static gdouble
+bench_collate_sort_names (GPtrArray *names)
+{
+  const gchar **sorted;
+  gint64        start;
+  gint64        elapsed;
+
+  sorted = g_new (const gchar *, names->len);
+  memcpy (sorted, names->pdata, names->len * sizeof (gchar *));
+
+  /* The order the completion showed before, by the collation of the locale */
+  start = g_get_monotonic_time ();
+  qsort (sorted, names->len, sizeof (gchar *), bench_collate_compare_names);
+  elapsed = g_get_monotonic_time () - start;
+
+  g_free (sorted);
+
+  return elapsed / 1000.0;
+}
+
+
+
+static gdouble
+bench_collate_add_names (GPtrArray *names,
+                         guint     *n_added)
+{
+  VerveCompletion  *completion;
+  GMainLoop        *loop;
+  VerveEnv         *env;
+  gchar           **added;
+  gint64            start;
+  gint64            elapsed;
+
+  /* Start from an environment which is done loading the (empty) $PATH */
+  loop = g_main_loop_new (NULL, FALSE);
+  env = verve_env_get ();
+  g_signal_connect (G_OBJECT (env), "load-binaries", G_CALLBACK (bench_collate_loaded), loop);
+  g_main_loop_run (loop);
+
+  completion = verve_completion_new (NULL);
+
+  /* Time the path a directory takes from the loader into the completion:
+   * dropping duplicates, copying the names, sorting them, merging them
+   * into the environment and merging the sorted batch into the index */
+  start = g_get_monotonic_time ();
+  added = verve_env_test_add_names (env, names);
+  *n_added = (added != NULL ? g_strv_length (added) : 0);
+  verve_completion_merge_sorted_items (completion, (gpointer *) added, *n_added);
+  elapsed = g_get_monotonic_time () - start;
+
+  verve_completion_free (completion);
+  g_free (added);
+
+  verve_env_shutdown ();
+  g_main_loop_unref (loop);
+
+  return elapsed / 1000.0;
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  static const guint  sizes[] = { 2000, 20000, 200000 };
+  static const gchar *stems[] = { "binary", "Binary", "café", "überprüfen", "make", "xfce4-panel" };
+  GRand              *rand;
+  GPtrArray          *names;
+  gchar              *root;
+  gdouble             collated;
+  gdouble             bytewise;
+  guint               n_added;
+  guint               i, j, run;
+
+  /* Sort the way the user's locale does */
+  setlocale (LC_ALL, "");
+
+  /* Nothing to scan, and keep the cache out of the user's home */
+  root = g_dir_make_tmp ("verve-bench-XXXXXX", NULL);
+  if (G_UNLIKELY (root == NULL))
+    return 1;
+
+  g_setenv ("PATH", "", TRUE);
+  g_setenv ("XDG_CACHE_HOME", root, TRUE);
+
+  g_print ("Collation locale: %s\n", setlocale (LC_COLLATE, NULL));
+  g_print ("%10s %10s %14s %14s %10s\n", "names", "added", "collate (ms)", "loader (ms)", "speedup");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      rand = g_rand_new_with_seed (i);
+      names = g_ptr_array_new_with_free_func (g_free);
+
+      /* Mostly ASCII names in random order, some of them accented */
+      for (j = 0; j < sizes[i]; j++)
+        g_ptr_array_add (names, g_strdup_printf ("%s-%u", stems[g_rand_int_range (rand, 0, G_N_ELEMENTS (stems))],
+                                                 g_rand_int (rand)));
+
+      for (run = 0, collated = bytewise = G_MAXDOUBLE; run < BENCH_N_RUNS; run++)
+        {
+          collated = MIN (collated, bench_collate_sort_names (names));
+          bytewise = MIN (bytewise, bench_collate_add_names (names, &n_added));
+        }
+
+      g_print ("%10u %10u %14.2f %14.2f %9.1fx\n", sizes[i], n_added, collated, bytewise, collated / MAX (bytewise, 0.001));
+
+      g_ptr_array_unref (names);
+      g_rand_free (rand);
+    }
+
+  g_remove (root);
+  g_free (root);
+
+  return 0;
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
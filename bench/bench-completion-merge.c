@@ -0,0 +1,169 @@
+/***************************************************************************
+ *            bench-completion-merge.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+
+#include "verve-completion.h"
+
+
+
+/* Number of times every merge is repeated, the fastest run is reported */
+#define BENCH_N_RUNS 5
+
+
+
+static GList   *bench_completion_binaries  (GStringChunk *strings,
+                                            guint         n_binaries);
+static GList   *bench_completion_history   (GStringChunk *strings,
+                                            GRand        *rand,
+                                            guint         n_history,
+                                            guint         n_binaries);
+static gdouble  bench_completion_merge     (GList        *binaries,
+                                            GList        *history,
+                                            guint        *n_items);
+
+
+
+static GList *
+bench_completion_binaries (GStringChunk *strings,
+                           guint         n_binaries)
+{
+  GList *binaries = NULL;
+  gchar  name[32];
+  guint  i;
+
+  for (i = 0; i < n_binaries; i++)
+    {
+      g_snprintf (name, sizeof (name), "binary-%07u", i);
+      binaries = g_list_prepend (binaries, g_string_chunk_insert_const (strings, name));
+    }
+
+  return binaries;
+}
+
+
+
+static GList *
+bench_completion_history (GStringChunk *strings,
+                          GRand        *rand,
+                          guint         n_history,
+                          guint         n_binaries)
+{
+  GList *history = NULL;
+  gchar  command[64];
+  guint  i;
+
+  /* A third of the commands name a binary, the others come with arguments.
+   * Both kinds repeat, like the commands of a real history do */
+  for (i = 0; i < n_history; i++)
+    {
+      if (i % 3 == 0)
+        g_snprintf (command, sizeof (command), "binary-%07u",
+                    g_rand_int_range (rand, 0, n_binaries));
+      else
+        g_snprintf (command, sizeof (command), "binary-%07u --file ~/src/project-%u",
+                    g_rand_int_range (rand, 0, n_binaries), g_rand_int_range (rand, 0, n_history / 2));
+
+      history = g_list_prepend (history, g_string_chunk_insert_const (strings, command));
+    }
+
+  return history;
+}
+
+
+
+static gdouble
+bench_completion_merge (GList  *binaries,
+                        GList  *history,
+                        guint  *n_items)
+{
+  VerveCompletion         *completion;
+  VerveCompletionSnapshot *snapshot;
+  gint64                   start;
+  gint64                   elapsed;
+  guint                    first;
+
+  /* Index the binaries the way they are known once $PATH is loaded */
+  completion = verve_completion_new (NULL);
+  verve_completion_add_items (completion, binaries);
+
+  /* Time merging the history into the index */
+  start = g_get_monotonic_time ();
+  verve_completion_merge_items (completion, history);
+  elapsed = g_get_monotonic_time () - start;
+
+  snapshot = verve_completion_get_snapshot (completion);
+  *n_items = verve_completion_snapshot_complete_range (snapshot, "", &first);
+  verve_completion_snapshot_unref (snapshot);
+
+  verve_completion_free (completion);
+
+  return elapsed / 1000.0;
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  static const guint sizes[][2] = { { 1000, 2000 }, { 10000, 20000 }, { 100000, 200000 } };
+  GStringChunk      *strings;
+  GRand             *rand;
+  GList             *binaries;
+  GList             *history;
+  gdouble            best;
+  gdouble            elapsed;
+  guint              n_items;
+  guint              i, run;
+
+  g_print ("%10s %10s %10s %12s %12s\n", "history", "binaries", "merged", "merge (ms)", "ns/item");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      strings = g_string_chunk_new (64 * 1024);
+      rand = g_rand_new_with_seed (i);
+
+      binaries = bench_completion_binaries (strings, sizes[i][1]);
+      history = bench_completion_history (strings, rand, sizes[i][0], sizes[i][1]);
+
+      for (run = 0, best = G_MAXDOUBLE; run < BENCH_N_RUNS; run++)
+        {
+          elapsed = bench_completion_merge (binaries, history, &n_items);
+          best = MIN (best, elapsed);
+        }
+
+      g_print ("%10u %10u %10u %12.2f %12.1f\n", sizes[i][0], sizes[i][1], n_items,
+               best, best * 1e6 / (sizes[i][0] + sizes[i][1]));
+
+      g_list_free (history);
+      g_list_free (binaries);
+      g_rand_free (rand);
+      g_string_chunk_free (strings);
+    }
+
+  return 0;
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,240 @@
+/***************************************************************************
+ *            bench-env-scan.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "verve-env-private.h"
+
+
+
+/* Number of $PATH directories the entries are spread across */
+#define BENCH_N_DIRS     4
+
+/* Every this many entries is a symlink to the entry before it */
+#define BENCH_LINK_EVERY 8
+
+
+
+static void     bench_env_remove_tree   (const gchar *path);
+static gchar   *bench_env_populate      (const gchar *root,
+                                         guint        n_entries);
+static void     bench_env_loaded        (VerveEnv    *env,
+                                         gpointer     user_data);
+static gdouble  bench_env_load          (guint       *n_entries,
+                                         guint       *n_syscalls);
+
+
+
+static void
+bench_env_remove_tree (const gchar *path)
+{
+  const gchar *name;
+  GDir        *dir;
+  gchar       *child;
+
+  /* Remove the contents of directories first */
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          child = g_build_filename (path, name, NULL);
+          bench_env_remove_tree (child);
+          g_free (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
+}
+
+
+
+static gchar *
+bench_env_populate (const gchar *root,
+                    guint        n_entries)
+{
+  GString *path;
+  gchar   *dirname;
+  gchar   *filename;
+  gchar    name[32];
+  gchar    target[32];
+  guint    per_dir = n_entries / BENCH_N_DIRS;
+  guint    d, i;
+  gint     fd;
+
+  path = g_string_new (NULL);
+
+  /* Each directory shares half of its names with the next one, so the
+   * scanner has to drop duplicates as it does with real $PATHs. Some of
+   * the entries are symlinks, like the alternatives in /usr/bin */
+  for (d = 0; d < BENCH_N_DIRS; d++)
+    {
+      g_snprintf (name, sizeof (name), "bin%u", d);
+      dirname = g_build_filename (root, name, NULL);
+      g_mkdir (dirname, 0755);
+
+      for (i = 0; i < per_dir; i++)
+        {
+          g_snprintf (name, sizeof (name), "binary-%07u", d * per_dir / 2 + i);
+          filename = g_build_filename (dirname, name, NULL);
+
+          if (i % BENCH_LINK_EVERY == BENCH_LINK_EVERY - 1)
+            {
+              g_snprintf (target, sizeof (target), "binary-%07u", d * per_dir / 2 + i - 1);
+              if (symlink (target, filename) != 0)
+                g_warning ("Could not create %s", filename);
+            }
+          else
+            {
+              fd = g_open (filename, O_CREAT | O_WRONLY, 0755);
+              if (fd >= 0)
+                close (fd);
+            }
+
+          g_free (filename);
+        }
+
+      if (path->len > 0)
+        g_string_append_c (path, G_SEARCHPATH_SEPARATOR);
+      g_string_append (path, dirname);
+
+      g_free (dirname);
+    }
+
+  return g_string_free (path, FALSE);
+}
+
+
+
+static void
+bench_env_loaded (VerveEnv *env,
+                  gpointer  user_data)
+{
+  g_main_loop_quit (user_data);
+}
+
+
+
+static gdouble
+bench_env_load (guint *n_entries,
+                guint *n_syscalls)
+{
+  GMainLoop *loop;
+  VerveEnv  *env;
+  gint64     start;
+  gint64     elapsed;
+
+  loop = g_main_loop_new (NULL, FALSE);
+
+  /* Time from creating the environment until all binaries are known */
+  start = g_get_monotonic_time ();
+
+  env = verve_env_get ();
+  g_signal_connect (G_OBJECT (env), "load-binaries", G_CALLBACK (bench_env_loaded), loop);
+  g_main_loop_run (loop);
+
+  elapsed = g_get_monotonic_time () - start;
+
+  verve_env_test_get_scan_counts (env, n_entries, n_syscalls);
+  verve_env_shutdown ();
+  g_main_loop_unref (loop);
+
+  return elapsed / 1000.0;
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  static const guint sizes[] = { 1000, 10000, 100000 };
+  gchar             *root;
+  gchar             *cache;
+  gchar             *dirs;
+  gchar             *path;
+  gdouble            scanned;
+  gdouble            cached;
+  guint              n_entries;
+  guint              n_syscalls;
+  guint              n_cached_entries;
+  guint              n_cached_syscalls;
+  guint              i;
+
+  root = g_dir_make_tmp ("verve-bench-XXXXXX", NULL);
+  if (G_UNLIKELY (root == NULL))
+    return 1;
+
+  /* Keep the cache out of the user's home. GLib looks the cache directory
+   * up only once, so it stays the same for all sizes */
+  cache = g_build_filename (root, "cache", NULL);
+  dirs = g_build_filename (root, "path", NULL);
+  g_setenv ("XDG_CACHE_HOME", cache, TRUE);
+
+  g_print ("%10s %12s %12s %14s %12s %12s\n", "entries", "scan (ms)", "ns/entry", "syscalls/entry", "cached (ms)", "ns/entry");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      /* Use a fresh set of directories and an empty cache for every size */
+      g_mkdir (dirs, 0700);
+      path = bench_env_populate (dirs, sizes[i]);
+      g_setenv ("PATH", path, TRUE);
+
+      /* The first load scans the directories, the second one reads the cache it wrote */
+      scanned = bench_env_load (&n_entries, &n_syscalls);
+      cached = bench_env_load (&n_cached_entries, &n_cached_syscalls);
+
+      g_print ("%10u %12.2f %12.1f %14.2f %12.2f %12.1f\n", sizes[i],
+               scanned, scanned * 1e6 / sizes[i],
+               n_entries > 0 ? (gdouble) n_syscalls / n_entries : 0.0,
+               cached, cached * 1e6 / sizes[i]);
+
+      /* Nothing should be scanned again while the directories did not change */
+      if (n_cached_entries > 0)
+        g_warning ("%u entries were scanned again (%u syscalls) instead of taken from the cache",
+                   n_cached_entries, n_cached_syscalls);
+
+      g_free (path);
+
+      /* Start over for the next size */
+      bench_env_remove_tree (dirs);
+      bench_env_remove_tree (cache);
+    }
+
+  bench_env_remove_tree (root);
+
+  g_free (dirs);
+  g_free (cache);
+  g_free (root);
+
+  return 0;
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,150 @@
+/***************************************************************************
+ *            bench-fuzzy.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <glib.h>
+
+#include "verve-completion.h"
+
+
+
+/* Number of candidates and the time a query may take with them */
+#define BENCH_N_CANDIDATES 100000
+#define BENCH_TARGET_MS    2.0
+
+/* Number of results shown by the plugin */
+#define BENCH_N_RESULTS    10
+
+/* Number of times every query is repeated, the fastest run is reported */
+#define BENCH_N_RUNS       20
+
+
+
+static GList   *bench_fuzzy_candidates  (GStringChunk    *strings,
+                                         GRand           *rand,
+                                         guint            n_candidates);
+static gdouble  bench_fuzzy_query       (VerveCompletion *completion,
+                                         const gchar     *pattern,
+                                         guint           *n_results);
+
+
+
+static GList *
+bench_fuzzy_candidates (GStringChunk *strings,
+                        GRand        *rand,
+                        guint         n_candidates)
+{
+  static const gchar *words[] = { "xfce4", "settings", "manager", "panel", "gst", "launch", "python3",
+                                  "config", "git", "remote", "http", "dbus", "send", "update", "mime",
+                                  "database", "gtk", "query", "immodules", "x86_64", "linux", "gnu",
+                                  "objdump", "pkg", "Thunar", "ffmpeg", "perl5", "db", "dump", "keygen" };
+  GString            *name;
+  GList              *candidates = NULL;
+  guint               i, n_words;
+
+  name = g_string_new (NULL);
+
+  /* Command names made of a few words, like "gst-launch-1.0" or
+   * "xfce4-settings-manager", with a number keeping them unique */
+  for (i = 0; i < n_candidates; i++)
+    {
+      g_string_truncate (name, 0);
+
+      for (n_words = g_rand_int_range (rand, 1, 4); n_words > 0; n_words--)
+        g_string_append_printf (name, "%s-", words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+
+      g_string_append_printf (name, "%u", i);
+      candidates = g_list_prepend (candidates, g_string_chunk_insert_const (strings, name->str));
+    }
+
+  g_string_free (name, TRUE);
+
+  return candidates;
+}
+
+
+
+static gdouble
+bench_fuzzy_query (VerveCompletion *completion,
+                   const gchar     *pattern,
+                   guint           *n_results)
+{
+  gpointer results[BENCH_N_RESULTS];
+  gint64   start;
+  gint64   elapsed;
+
+  /* Time scanning all candidates for the best matches */
+  start = g_get_monotonic_time ();
+  *n_results = verve_completion_complete_fuzzy (completion, pattern, results, BENCH_N_RESULTS);
+  elapsed = g_get_monotonic_time () - start;
+
+  return elapsed / 1000.0;
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  static const gchar *patterns[] = { "x", "gst", "xfsetm", "pydbu", "ThunarQ", "zzz" };
+  VerveCompletion    *completion;
+  GStringChunk       *strings;
+  GRand              *rand;
+  GList              *candidates;
+  gdouble             best;
+  gdouble             worst = 0;
+  guint               n_results;
+  guint               i, run;
+
+  strings = g_string_chunk_new (64 * 1024);
+  rand = g_rand_new_with_seed (0);
+
+  candidates = bench_fuzzy_candidates (strings, rand, BENCH_N_CANDIDATES);
+  completion = verve_completion_new (NULL);
+  verve_completion_add_items (completion, candidates);
+
+  g_print ("%u candidates, target %.1f ms per query\n", BENCH_N_CANDIDATES, BENCH_TARGET_MS);
+  g_print ("%10s %10s %12s %12s\n", "pattern", "results", "query (ms)", "ns/item");
+
+  for (i = 0; i < G_N_ELEMENTS (patterns); i++)
+    {
+      for (run = 0, best = G_MAXDOUBLE; run < BENCH_N_RUNS; run++)
+        best = MIN (best, bench_fuzzy_query (completion, patterns[i], &n_results));
+
+      g_print ("%10s %10u %12.3f %12.1f\n", patterns[i], n_results, best, best * 1e6 / BENCH_N_CANDIDATES);
+
+      worst = MAX (worst, best);
+    }
+
+  g_print ("Slowest query: %.3f ms, target %s\n", worst, worst <= BENCH_TARGET_MS ? "met" : "missed");
+
+  verve_completion_free (completion);
+  g_list_free (candidates);
+  g_rand_free (rand);
+  g_string_chunk_free (strings);
+
+  return 0;
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,515 @@
+/***************************************************************************
+ *            verve-arguments.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "verve-arguments.h"
+#include "verve-history.h"
+
+
+
+/*********************************************************************
+ *
+ * Argument index
+ * --------------
+ *
+ * For every program launched from the history, the index remembers
+ * the arguments it was used with. A command line contributes all its
+ * argument n-grams starting at the first argument, e.g. "make -C
+ * ~/src/x" adds "-C" and "-C ~/src/x" to the arguments of "make".
+ * The arguments of a program are kept ordered by how often and then
+ * how recently they were used, so completing them is a single scan.
+ * Whenever a program has to forget arguments to make room for new
+ * ones, its counts are halved, so arguments used a lot long ago give
+ * way to those used lately.
+ *
+ * All strings are interned in one string chunk, which is rebuilt from
+ * the remembered strings whenever the index is written. The index is written
+ * shortly after arguments were learned, so a crash loses at most the
+ * last few of them, and on shutdown. It uses the compact form below, so loading it is a single
+ * pass over a mapped file. All integers are stored in host byte order.
+ *
+ *   header:  "VRVA" | version (u32) | number of records (u32) | 0 (u32)
+ *   record:  count (u32) | 0 (u32) | last use (i64) | program '\0' arguments '\0'
+ *
+ *********************************************************************/
+
+#define VERVE_ARGUMENTS_MAGIC       "VRVA"
+#define VERVE_ARGUMENTS_VERSION     1
+#define VERVE_ARGUMENTS_HEADER_SIZE 16
+#define VERVE_ARGUMENTS_RECORD_SIZE 16
+
+/* Longest argument n-gram, in words */
+#define VERVE_ARGUMENTS_MAX_WORDS       4
+
+/* Number of arguments remembered per program */
+#define VERVE_ARGUMENTS_MAX_PER_PROGRAM 32
+
+/* Seconds between learning arguments and writing the index */
+#define VERVE_ARGUMENTS_WRITE_DELAY     30
+
+
+
+typedef struct
+{
+  const gchar *arguments;
+  guint32      count;
+  gint64       last_use;
+} VerveArgumentsEntry;
+
+
+
+static gchar        *index_filename = NULL;
+static guint         index_users = 0;
+
+/* Pending write of the index */
+static guint         write_source_id = 0;
+
+/* Interned program names and arguments */
+static GStringChunk *strings = NULL;
+
+/* Program -> GArray of VerveArgumentsEntry, best first */
+static GHashTable   *programs = NULL;
+
+
+
+static gboolean
+verve_arguments_is_better (const VerveArgumentsEntry *a,
+                           const VerveArgumentsEntry *b)
+{
+  return a->count > b->count || (a->count == b->count && a->last_use > b->last_use);
+}
+
+
+
+static gint
+verve_arguments_compare (gconstpointer a,
+                         gconstpointer b)
+{
+  /* Best arguments first */
+  if (verve_arguments_is_better (a, b))
+    return -1;
+
+  return verve_arguments_is_better (b, a) ? 1 : 0;
+}
+
+
+
+static void
+verve_arguments_age (GArray *entries)
+{
+  guint i;
+
+  /* Halve all counts, equal counts are ordered by the last use then */
+  for (i = 0; i < entries->len; i++)
+    g_array_index (entries, VerveArgumentsEntry, i).count /= 2;
+
+  g_array_sort (entries, verve_arguments_compare);
+}
+
+
+
+static void
+verve_arguments_bump (const gchar *program,
+                      const gchar *arguments,
+                      guint32      count,
+                      gint64       last_use)
+{
+  VerveArgumentsEntry *entry;
+  VerveArgumentsEntry  tmp;
+  GArray              *entries;
+  guint                i;
+
+  /* Interned strings can be compared by their addresses */
+  program = g_string_chunk_insert_const (strings, program);
+  arguments = g_string_chunk_insert_const (strings, arguments);
+
+  entries = g_hash_table_lookup (programs, program);
+
+  if (entries == NULL)
+    {
+      entries = g_array_new (FALSE, FALSE, sizeof (VerveArgumentsEntry));
+      g_hash_table_insert (programs, (gpointer) program, entries);
+    }
+
+  for (i = 0; i < entries->len; i++)
+    if (g_array_index (entries, VerveArgumentsEntry, i).arguments == arguments)
+      break;
+
+  if (i == entries->len)
+    {
+      /* Make room by forgetting the least often and least recently used
+       * arguments. Age the others first, otherwise every newcomer would
+       * only ever replace the previous one */
+      if (entries->len >= VERVE_ARGUMENTS_MAX_PER_PROGRAM)
+        {
+          verve_arguments_age (entries);
+          g_array_set_size (entries, entries->len - 1);
+        }
+
+      tmp.arguments = arguments;
+      tmp.count = 0;
+      tmp.last_use = last_use;
+      g_array_append_val (entries, tmp);
+
+      i = entries->len - 1;
+    }
+
+  entry = &g_array_index (entries, VerveArgumentsEntry, i);
+  entry->count = (entry->count > G_MAXUINT32 - count ? G_MAXUINT32 : entry->count + count);
+  entry->last_use = MAX (entry->last_use, last_use);
+
+  /* Move the arguments up to keep the array ordered */
+  for (; i > 0 && verve_arguments_is_better (&g_array_index (entries, VerveArgumentsEntry, i),
+                                             &g_array_index (entries, VerveArgumentsEntry, i - 1)); i--)
+    {
+      tmp = g_array_index (entries, VerveArgumentsEntry, i);
+      g_array_index (entries, VerveArgumentsEntry, i) = g_array_index (entries, VerveArgumentsEntry, i - 1);
+      g_array_index (entries, VerveArgumentsEntry, i - 1) = tmp;
+    }
+}
+
+
+
+static void
+verve_arguments_add_at (const gchar *command,
+                        gint64       time)
+{
+  const gchar *program = NULL;
+  GString     *arguments;
+  gchar      **words;
+  guint        i, n;
+
+  words = g_strsplit_set (command, " \t", -1);
+  arguments = g_string_new (NULL);
+
+  /* Add the n-grams of the arguments, the first word is the program */
+  for (i = 0, n = 0; words[i] != NULL && n < VERVE_ARGUMENTS_MAX_WORDS; i++)
+    {
+      if (*words[i] == '\0')
+        continue;
+
+      if (program == NULL)
+        {
+          program = words[i];
+          continue;
+        }
+
+      if (arguments->len > 0)
+        g_string_append_c (arguments, ' ');
+      g_string_append (arguments, words[i]);
+      n++;
+
+      verve_arguments_bump (program, arguments->str, 1, time);
+    }
+
+  g_string_free (arguments, TRUE);
+  g_strfreev (words);
+}
+
+
+
+static gboolean
+verve_arguments_load (void)
+{
+  GMappedFile *mapped;
+  const gchar *contents;
+  const gchar *end;
+  gsize        length;
+  gsize        offset;
+  guint32      version;
+  guint32      n_records;
+  guint32      i;
+
+  mapped = g_mapped_file_new (index_filename, FALSE, NULL);
+
+  /* No index yet */
+  if (G_UNLIKELY (mapped == NULL))
+    return FALSE;
+
+  contents = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+
+  /* Validate the header, ignore indexes written by other versions of the plugin */
+  if (length < VERVE_ARGUMENTS_HEADER_SIZE || memcmp (contents, VERVE_ARGUMENTS_MAGIC, 4) != 0)
+    {
+      g_mapped_file_unref (mapped);
+      return FALSE;
+    }
+
+  memcpy (&version, contents + 4, sizeof (guint32));
+  memcpy (&n_records, contents + 8, sizeof (guint32));
+
+  if (version != VERVE_ARGUMENTS_VERSION)
+    {
+      g_mapped_file_unref (mapped);
+      return FALSE;
+    }
+
+  end = contents + length;
+
+  /* Read all records, stop at the first truncated one */
+  for (i = 0, offset = VERVE_ARGUMENTS_HEADER_SIZE; i < n_records; i++)
+    {
+      const gchar *program;
+      const gchar *arguments;
+      const gchar *p;
+      guint32      count;
+      gint64       last_use;
+
+      if (offset + VERVE_ARGUMENTS_RECORD_SIZE > length)
+        break;
+
+      memcpy (&count, contents + offset, sizeof (guint32));
+      memcpy (&last_use, contents + offset + 8, sizeof (gint64));
+
+      program = contents + offset + VERVE_ARGUMENTS_RECORD_SIZE;
+      p = memchr (program, '\0', end - program);
+      if (p == NULL)
+        break;
+
+      arguments = p + 1;
+      p = (arguments < end ? memchr (arguments, '\0', end - arguments) : NULL);
+      if (p == NULL)
+        break;
+
+      verve_arguments_bump (program, arguments, count, last_use);
+
+      offset = p + 1 - contents;
+    }
+
+  g_mapped_file_unref (mapped);
+
+  return TRUE;
+}
+
+
+
+static void
+verve_arguments_compact (void)
+{
+  GHashTableIter iter;
+  GStringChunk  *live;
+  GHashTable    *compacted;
+  gpointer       program;
+  gpointer       entries;
+  guint          i;
+
+  live = g_string_chunk_new (4096);
+  compacted = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_array_unref);
+
+  /* Intern the remembered strings again, forgotten arguments stay behind in the old chunk */
+  g_hash_table_iter_init (&iter, programs);
+  while (g_hash_table_iter_next (&iter, &program, &entries))
+    {
+      for (i = 0; i < ((GArray *) entries)->len; i++)
+        {
+          VerveArgumentsEntry *entry = &g_array_index ((GArray *) entries, VerveArgumentsEntry, i);
+
+          entry->arguments = g_string_chunk_insert_const (live, entry->arguments);
+        }
+
+      g_hash_table_insert (compacted, g_string_chunk_insert_const (live, program), entries);
+      g_hash_table_iter_steal (&iter);
+    }
+
+  g_hash_table_destroy (programs);
+  programs = compacted;
+  g_string_chunk_free (strings);
+  strings = live;
+}
+
+
+
+static void
+verve_arguments_write (void)
+{
+  GHashTableIter iter;
+  GString       *contents;
+  gpointer       program;
+  gpointer       entries;
+  guint32        value;
+  guint32        n_records = 0;
+  guint          i;
+
+  /* Release the memory of forgotten arguments */
+  verve_arguments_compact ();
+
+  contents = g_string_sized_new (16 * 1024);
+
+  /* Write the header, the number of records is filled in below */
+  g_string_append_len (contents, VERVE_ARGUMENTS_MAGIC, 4);
+  value = VERVE_ARGUMENTS_VERSION;
+  g_string_append_len (contents, (const gchar *) &value, sizeof (guint32));
+  value = 0;
+  g_string_append_len (contents, (const gchar *) &value, sizeof (guint32));
+  g_string_append_len (contents, (const gchar *) &value, sizeof (guint32));
+
+  /* Write one record per program and arguments, best arguments first */
+  g_hash_table_iter_init (&iter, programs);
+  while (g_hash_table_iter_next (&iter, &program, &entries))
+    {
+      for (i = 0; i < ((GArray *) entries)->len; i++)
+        {
+          const VerveArgumentsEntry *entry = &g_array_index ((GArray *) entries, VerveArgumentsEntry, i);
+
+          value = entry->count;
+          g_string_append_len (contents, (const gchar *) &value, sizeof (guint32));
+          value = 0;
+          g_string_append_len (contents, (const gchar *) &value, sizeof (guint32));
+          g_string_append_len (contents, (const gchar *) &entry->last_use, sizeof (gint64));
+          g_string_append_len (contents, program, strlen (program) + 1);
+          g_string_append_len (contents, entry->arguments, strlen (entry->arguments) + 1);
+
+          n_records++;
+        }
+    }
+
+  memcpy (contents->str + 8, &n_records, sizeof (guint32));
+
+  /* Replace the index atomically, a failure just means starting over from the history */
+  g_file_set_contents (index_filename, contents->str, contents->len, NULL);
+
+  g_string_free (contents, TRUE);
+}
+
+
+
+static gboolean
+verve_arguments_write_timeout (gpointer user_data)
+{
+  write_source_id = 0;
+
+  verve_arguments_write ();
+
+  return FALSE;
+}
+
+
+
+void
+verve_arguments_init (void)
+{
+  VerveHistoryIter iter;
+  gboolean         valid;
+  gint64           now;
+
+  /* The index is shared by all plugin instances */
+  if (index_users++ > 0)
+    return;
+
+  strings = g_string_chunk_new (4096);
+  programs = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_array_unref);
+
+  index_filename = xfce_resource_save_location (XFCE_RESOURCE_DATA, "xfce4/Verve/arguments", TRUE);
+
+  if (G_LIKELY (index_filename != NULL) && verve_arguments_load ())
+    return;
+
+  /* Without an index learn from the history, oldest commands first */
+  now = g_get_real_time () / G_USEC_PER_SEC;
+  for (valid = verve_history_iter_init_oldest (&iter); valid; valid = verve_history_iter_newer (&iter))
+    verve_arguments_add_at (verve_history_iter_get_command (&iter), now);
+}
+
+
+
+void
+verve_arguments_shutdown (void)
+{
+  if (index_users == 0 || --index_users > 0)
+    return;
+
+  /* Write the index now instead of waiting for the pending write */
+  if (write_source_id != 0)
+    {
+      g_source_remove (write_source_id);
+      write_source_id = 0;
+    }
+
+  if (G_LIKELY (index_filename != NULL))
+    verve_arguments_write ();
+
+  g_hash_table_destroy (programs);
+  programs = NULL;
+  g_string_chunk_free (strings);
+  strings = NULL;
+  g_free (index_filename);
+  index_filename = NULL;
+}
+
+
+
+void
+verve_arguments_add (const gchar *command)
+{
+  /* Nothing to learn before the index is loaded */
+  if (G_UNLIKELY (programs == NULL))
+    return;
+
+  verve_arguments_add_at (command, g_get_real_time () / G_USEC_PER_SEC);
+
+  /* Save the learned arguments soon, together with those learned meanwhile */
+  if (G_LIKELY (index_filename != NULL) && write_source_id == 0)
+    write_source_id = g_timeout_add_seconds (VERVE_ARGUMENTS_WRITE_DELAY, verve_arguments_write_timeout, NULL);
+}
+
+
+
+/* Replaces the contents of results with the arguments program was used
+ * with which start with (but are longer than) prefix, best first. */
+guint
+verve_arguments_complete (const gchar *program,
+                          const gchar *prefix,
+                          GPtrArray   *results)
+{
+  GArray *entries;
+  gsize   len;
+  guint   i;
+
+  g_ptr_array_set_size (results, 0);
+
+  if (G_UNLIKELY (programs == NULL))
+    return 0;
+
+  entries = g_hash_table_lookup (programs, program);
+  if (entries == NULL)
+    return 0;
+
+  len = strlen (prefix);
+
+  for (i = 0; i < entries->len; i++)
+    {
+      const gchar *arguments = g_array_index (entries, VerveArgumentsEntry, i).arguments;
+
+      if (strncmp (arguments, prefix, len) == 0 && arguments[len] != '\0')
+        g_ptr_array_add (results, (gpointer) arguments);
+    }
+
+  return results->len;
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,42 @@
+/***************************************************************************
+ *            verve-arguments.h
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __VERVE_ARGUMENTS_H__
+#define __VERVE_ARGUMENTS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS;
+
+void  verve_arguments_init     (void);
+void  verve_arguments_shutdown (void);
+
+void  verve_arguments_add      (const gchar *command);
+guint verve_arguments_complete (const gchar *program,
+                                const gchar *prefix,
+                                GPtrArray   *results);
+
+G_END_DECLS;
+
+#endif /* !__VERVE_ARGUMENTS_H__ */
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
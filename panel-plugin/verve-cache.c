@@ -0,0 +1,292 @@
+/***************************************************************************
+ *            verve-cache.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "verve-cache.h"
+
+
+
+/*********************************************************************
+ *
+ * Binary cache file
+ * -----------------
+ *
+ * The cache remembers the executables of every $PATH directory so
+ * that only directories which changed since the last run have to be
+ * scanned again. All integers are stored in host byte order, the file
+ * is only ever read on the machine which wrote it.
+ *
+ *   header:  "VRVB" | version (u32) | number of records (u32) | 0 (u32)
+ *   record:  VerveCacheRecord | path '\0' | name '\0' name '\0' ...
+ *
+ *********************************************************************/
+
+#define VERVE_CACHE_MAGIC       "VRVB"
+#define VERVE_CACHE_VERSION     1
+#define VERVE_CACHE_HEADER_SIZE 16
+
+
+
+typedef struct
+{
+  guint64 dev;
+  guint64 ino;
+  gint64  mtime;
+  guint32 mtime_nsec;
+  guint32 n_names;
+  guint32 path_len;
+  guint32 names_len;
+} VerveCacheRecord;
+
+
+
+struct _VerveCache
+{
+  GMappedFile *mapped;
+
+  /* Directory path -> record header inside the mapped file */
+  GHashTable  *records;
+};
+
+
+
+static gchar *
+verve_cache_get_filename (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "xfce4", "Verve", "binaries", NULL);
+}
+
+
+
+VerveCache *
+verve_cache_load (void)
+{
+  VerveCache  *cache;
+  GMappedFile *mapped;
+  const gchar *contents;
+  gchar       *filename;
+  gsize        length;
+  gsize        offset;
+  guint32      version;
+  guint32      n_records;
+  guint32      i;
+
+  /* Map the cache file into memory, the kernel pages it in on demand */
+  filename = verve_cache_get_filename ();
+  mapped = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+
+  /* No cache yet */
+  if (G_UNLIKELY (mapped == NULL))
+    return NULL;
+
+  contents = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+
+  /* Validate the header */
+  if (length < VERVE_CACHE_HEADER_SIZE || memcmp (contents, VERVE_CACHE_MAGIC, 4) != 0)
+    {
+      g_mapped_file_unref (mapped);
+      return NULL;
+    }
+
+  memcpy (&version, contents + 4, sizeof (guint32));
+  memcpy (&n_records, contents + 8, sizeof (guint32));
+
+  /* Ignore caches written by other versions of the plugin */
+  if (version != VERVE_CACHE_VERSION)
+    {
+      g_mapped_file_unref (mapped);
+      return NULL;
+    }
+
+  cache = g_new0 (VerveCache, 1);
+  cache->mapped = mapped;
+  cache->records = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Index all records, stop at the first truncated or corrupt one */
+  for (i = 0, offset = VERVE_CACHE_HEADER_SIZE; i < n_records; i++)
+    {
+      VerveCacheRecord record;
+      const gchar     *path;
+      gsize            record_len;
+
+      if (offset + sizeof (VerveCacheRecord) > length)
+        break;
+
+      memcpy (&record, contents + offset, sizeof (VerveCacheRecord));
+
+      record_len = sizeof (VerveCacheRecord) + (gsize) record.path_len + 1 + record.names_len;
+      if (offset + record_len > length)
+        break;
+
+      /* Path and name data have to be NUL-terminated */
+      path = contents + offset + sizeof (VerveCacheRecord);
+      if (path[record.path_len] != '\0'
+          || (record.names_len > 0 && path[record.path_len + record.names_len] != '\0'))
+        break;
+
+      g_hash_table_insert (cache->records, (gpointer) path, (gpointer) (contents + offset));
+
+      offset += record_len;
+    }
+
+  return cache;
+}
+
+
+
+GPtrArray *
+verve_cache_lookup (VerveCache          *cache,
+                    const VerveCacheDir *dir)
+{
+  VerveCacheRecord record;
+  GPtrArray       *names;
+  const gchar     *data;
+  const gchar     *name;
+  const gchar     *end;
+  guint32          i;
+
+  if (cache == NULL)
+    return NULL;
+
+  /* Look for a record of this directory */
+  data = g_hash_table_lookup (cache->records, dir->path);
+  if (data == NULL)
+    return NULL;
+
+  memcpy (&record, data, sizeof (VerveCacheRecord));
+
+  /* The record is stale if the directory was replaced or modified */
+  if (record.dev != dir->dev
+      || record.ino != dir->ino
+      || record.mtime != dir->mtime
+      || record.mtime_nsec != dir->mtime_nsec)
+    return NULL;
+
+  /* Copy the names out of the mapped file */
+  names = g_ptr_array_new_full (record.n_names, g_free);
+  name = data + sizeof (VerveCacheRecord) + record.path_len + 1;
+  end = name + record.names_len;
+
+  for (i = 0; i < record.n_names && name < end; i++)
+    {
+      g_ptr_array_add (names, g_strdup (name));
+      name += strlen (name) + 1;
+    }
+
+  return names;
+}
+
+
+
+guint
+verve_cache_get_n_dirs (VerveCache *cache)
+{
+  return cache != NULL ? g_hash_table_size (cache->records) : 0;
+}
+
+
+
+void
+verve_cache_free (VerveCache *cache)
+{
+  if (cache == NULL)
+    return;
+
+  g_hash_table_destroy (cache->records);
+  g_mapped_file_unref (cache->mapped);
+  g_free (cache);
+}
+
+
+
+void
+verve_cache_write (const VerveCacheDir *dirs,
+                   guint                n_dirs)
+{
+  GString *contents;
+  gchar   *filename;
+  gchar   *dirname;
+  guint32  value;
+  guint    i, j;
+
+  contents = g_string_sized_new (64 * 1024);
+
+  /* Write the header */
+  g_string_append_len (contents, VERVE_CACHE_MAGIC, 4);
+  value = VERVE_CACHE_VERSION;
+  g_string_append_len (contents, (const gchar *) &value, sizeof (guint32));
+  value = n_dirs;
+  g_string_append_len (contents, (const gchar *) &value, sizeof (guint32));
+  value = 0;
+  g_string_append_len (contents, (const gchar *) &value, sizeof (guint32));
+
+  /* Write one record per directory */
+  for (i = 0; i < n_dirs; i++)
+    {
+      VerveCacheRecord record;
+      gsize            record_offset = contents->len;
+
+      record.dev = dirs[i].dev;
+      record.ino = dirs[i].ino;
+      record.mtime = dirs[i].mtime;
+      record.mtime_nsec = dirs[i].mtime_nsec;
+      record.n_names = dirs[i].names->len;
+      record.path_len = strlen (dirs[i].path);
+      record.names_len = 0;
+
+      /* Reserve space for the record header, it is filled in below */
+      g_string_append_len (contents, (const gchar *) &record, sizeof (VerveCacheRecord));
+      g_string_append_len (contents, dirs[i].path, record.path_len + 1);
+
+      for (j = 0; j < dirs[i].names->len; j++)
+        {
+          const gchar *name = g_ptr_array_index (dirs[i].names, j);
+          gsize        name_len = strlen (name) + 1;
+
+          g_string_append_len (contents, name, name_len);
+          record.names_len += name_len;
+        }
+
+      memcpy (contents->str + record_offset, &record, sizeof (VerveCacheRecord));
+    }
+
+  /* Make sure the cache directory exists */
+  filename = verve_cache_get_filename ();
+  dirname = g_path_get_dirname (filename);
+
+  /* Replace the cache file atomically, a failure just means a slower next start */
+  if (g_mkdir_with_parents (dirname, 0700) == 0)
+    g_file_set_contents (filename, contents->str, contents->len, NULL);
+
+  g_free (dirname);
+  g_free (filename);
+  g_string_free (contents, TRUE);
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *            verve-cache.h
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __VERVE_CACHE_H__
+#define __VERVE_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS;
+
+typedef struct _VerveCache    VerveCache;
+typedef struct _VerveCacheDir VerveCacheDir;
+
+/* A $PATH directory together with the data used to validate its cache record */
+struct _VerveCacheDir
+{
+  const gchar *path;
+  guint64      dev;
+  guint64      ino;
+  gint64       mtime;
+  guint32      mtime_nsec;
+
+  /* Names of the executables in this directory */
+  GPtrArray   *names;
+};
+
+VerveCache *verve_cache_load       (void);
+GPtrArray  *verve_cache_lookup     (VerveCache          *cache,
+                                    const VerveCacheDir *dir);
+guint       verve_cache_get_n_dirs (VerveCache          *cache);
+void        verve_cache_free       (VerveCache          *cache);
+
+void        verve_cache_write      (const VerveCacheDir *dirs,
+                                    guint                n_dirs);
+
+G_END_DECLS;
+
+#endif /* !__VERVE_CACHE_H__ */
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
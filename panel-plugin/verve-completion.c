@@ -21,49 +21,252 @@
 #include <string.h>
 
 
+static void verve_completion_index_insert  (VerveCompletion *cmp,
+                                            gpointer item);
+static void verve_completion_index_merge   (VerveCompletion *cmp,
+                                            gpointer *items,
+                                            guint n_items,
+                                            gboolean unique);
+static void verve_completion_publish       (VerveCompletion *cmp,
+                                            VerveCompletionSnapshot *snapshot);
+static gint verve_completion_index_compare (gconstpointer a,
+                                            gconstpointer b,
+                                            gpointer user_data);
+
+
+/* An immutable version of the sorted index. Every change builds a new
+ * version off to the side, merging the delta into a copy of the current
+ * one, and then swaps it in; a reader keeps the version it started with
+ * alive by holding a reference. */
+struct _VerveCompletionSnapshot
+{
+  gint ref_count;
+  VerveCompletionFunc func;
+
+  /* items sorted by their strings */
+  GPtrArray *index;
+
+  /* fuzzy matching data of the index entries (VerveFuzzyKey) */
+  GArray *keys;
+};
+
+
+typedef struct
+{
+  gdouble rank;
+  guint index;
+} VerveCompletionRanked;
+
+
+typedef struct
+{
+  guint distance;
+  gdouble rank;
+  guint index;
+} VerveCompletionSimilar;
+
+
+/* state of verve_completion_complete_similar () */
+typedef struct
+{
+  VerveCompletion *cmp;
+  VerveCompletionSnapshot *snapshot;
+  GArray *matches;
+} VerveCompletionSimilarSearch;
+
+
+static const gchar *
+verve_completion_item_string (VerveCompletionFunc func,
+                              gpointer item)
+{
+  return func ? func (item) : (const gchar *) item;
+}
+
+
+static VerveCompletionSnapshot *
+verve_completion_snapshot_new (VerveCompletionFunc func,
+                               guint reserved_size)
+{
+  VerveCompletionSnapshot *snapshot;
+
+  snapshot = g_new (VerveCompletionSnapshot, 1);
+  snapshot->ref_count = 1;
+  snapshot->func = func;
+  snapshot->index = g_ptr_array_sized_new (reserved_size);
+  snapshot->keys = g_array_sized_new (FALSE, FALSE, sizeof (VerveFuzzyKey), reserved_size);
+
+  return snapshot;
+}
+
+
+VerveCompletionSnapshot *
+verve_completion_snapshot_ref (VerveCompletionSnapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  g_atomic_int_inc (&snapshot->ref_count);
+
+  return snapshot;
+}
+
+
+void
+verve_completion_snapshot_unref (VerveCompletionSnapshot *snapshot)
+{
+  g_return_if_fail (snapshot != NULL);
+
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  g_ptr_array_free (snapshot->index, TRUE);
+  g_array_free (snapshot->keys, TRUE);
+  g_free (snapshot);
+}
+
+
 VerveCompletion *
 verve_completion_new (VerveCompletionFunc func)
 {
   VerveCompletion *gcomp;
 
   gcomp = g_new (VerveCompletion, 1);
-  gcomp->items = NULL;
-  gcomp->cache = NULL;
-  gcomp->prefix = NULL;
   gcomp->func = func;
-  gcomp->strncmp_func = strncmp;
+  gcomp->snapshot = verve_completion_snapshot_new (func, 0);
+  gcomp->trie = verve_trie_new ();
+  gcomp->rank_func = NULL;
+  gcomp->ranked = g_array_new (FALSE, FALSE, sizeof (VerveCompletionRanked));
 
   return gcomp;
 }
 
 
+void
+verve_completion_set_rank_func (VerveCompletion *cmp,
+                                VerveCompletionRankFunc rank_func)
+{
+  g_return_if_fail (cmp != NULL);
+
+  cmp->rank_func = rank_func;
+}
+
+
 void
 verve_completion_add_items (VerveCompletion *cmp,
                             GList *items)
 {
+  GPtrArray *sorted;
   GList *it;
 
   g_return_if_fail (cmp != NULL);
 
-  /* optimize adding to cache? */
-  if (cmp->cache)
-    {
-      g_list_free (cmp->cache);
-      cmp->cache = NULL;
-    }
+  if (!items)
+    return;
 
-  if (cmp->prefix)
+  /* a single item (e.g. a command just executed) goes right into place */
+  if (!items->next)
     {
-      g_free (cmp->prefix);
-      cmp->prefix = NULL;
+      verve_completion_index_insert (cmp, items->data);
+      return;
     }
 
-  it = items;
-  while (it)
+  /* sort larger batches once and merge them into a new version, so no
+   * query ever has to sort the whole index */
+  sorted = g_ptr_array_new ();
+  for (it = items; it; it = it->next)
+    g_ptr_array_add (sorted, it->data);
+
+  g_ptr_array_sort_with_data (sorted, verve_completion_index_compare, cmp->snapshot);
+  verve_completion_index_merge (cmp, sorted->pdata, sorted->len, FALSE);
+
+  g_ptr_array_free (sorted, TRUE);
+}
+
+
+/* Like verve_completion_merge_items (), for n_items items which are sorted
+ * bytewise by their strings already (e.g. a batch of binaries delivered by
+ * the environment). They are merge-joined with the index as they are. */
+void
+verve_completion_merge_sorted_items (VerveCompletion *cmp,
+                                     gpointer *items,
+                                     guint n_items)
+{
+  g_return_if_fail (cmp != NULL);
+  g_return_if_fail (items != NULL || n_items == 0);
+
+  if (n_items > 0)
+    verve_completion_index_merge (cmp, items, n_items, TRUE);
+}
+
+
+/* Adds those of items which aren't among the completion items yet, dropping
+ * duplicates. The new items are sorted once and merge-joined with the
+ * sorted index, which takes linear time instead of a rebuild. */
+void
+verve_completion_merge_items (VerveCompletion *cmp,
+                              GList *items)
+{
+  GPtrArray *sorted;
+  GList *it;
+
+  g_return_if_fail (cmp != NULL);
+
+  if (!items)
+    return;
+
+  /* sort the new items the way the index is sorted */
+  sorted = g_ptr_array_new ();
+  for (it = items; it; it = it->next)
+    g_ptr_array_add (sorted, it->data);
+
+  g_ptr_array_sort_with_data (sorted, verve_completion_index_compare, cmp->snapshot);
+  verve_completion_index_merge (cmp, sorted->pdata, sorted->len, TRUE);
+
+  g_ptr_array_free (sorted, TRUE);
+}
+
+
+void
+verve_completion_remove_items (VerveCompletion *cmp,
+                               GList *items)
+{
+  VerveCompletionSnapshot *old;
+  VerveCompletionSnapshot *snapshot;
+  GHashTable *removed;
+  GList *it;
+  guint i;
+
+  g_return_if_fail (cmp != NULL);
+
+  if (!items)
+    return;
+
+  old = cmp->snapshot;
+
+  /* the items to drop, each of them once */
+  removed = g_hash_table_new (NULL, NULL);
+  for (it = items; it; it = it->next)
+    g_hash_table_add (removed, it->data);
+
+  /* copy the current version without them in one pass, the order and
+   * the fuzzy matching data of the remaining items stay as they are */
+  snapshot = verve_completion_snapshot_new (cmp->func, old->index->len);
+  for (i = 0; i < old->index->len; i++)
     {
-      cmp->items = g_list_prepend (cmp->items, it->data);
-      it = it->next;
+      gpointer item = g_ptr_array_index (old->index, i);
+
+      if (g_hash_table_remove (removed, item))
+        {
+          verve_trie_remove (cmp->trie, verve_completion_item_string (cmp->func, item));
+          continue;
+        }
+
+      g_ptr_array_add (snapshot->index, item);
+      g_array_append_val (snapshot->keys, g_array_index (old->keys, VerveFuzzyKey, i));
     }
+
+  g_hash_table_destroy (removed);
+
+  verve_completion_publish (cmp, snapshot);
 }
 
 
@@ -72,73 +275,416 @@ verve_completion_clear_items (VerveCompletion *cmp)
 {
   g_return_if_fail (cmp != NULL);
 
-  g_list_free (cmp->items);
-  cmp->items = NULL;
-  g_list_free (cmp->cache);
-  cmp->cache = NULL;
-  g_free (cmp->prefix);
-  cmp->prefix = NULL;
+  verve_completion_publish (cmp, verve_completion_snapshot_new (cmp->func, 0));
+  verve_trie_free (cmp->trie);
+  cmp->trie = verve_trie_new ();
 }
 
 
-GList *
-verve_completion_complete (VerveCompletion *cmp,
-                           const gchar *prefix)
+static gint
+verve_completion_index_compare (gconstpointer a,
+                                gconstpointer b,
+                                gpointer user_data)
 {
-  gsize plen, len;
-  gboolean done = FALSE;
-  GList *list;
+  VerveCompletionSnapshot *snapshot = user_data;
 
-  g_return_val_if_fail (cmp != NULL, NULL);
-  g_return_val_if_fail (prefix != NULL, NULL);
+  return strcmp (verve_completion_item_string (snapshot->func, *(gpointer *) a),
+                 verve_completion_item_string (snapshot->func, *(gpointer *) b));
+}
 
-  len = strlen (prefix);
-  if (cmp->prefix && cmp->cache)
+
+static void
+verve_completion_publish (VerveCompletion *cmp,
+                          VerveCompletionSnapshot *snapshot)
+{
+  VerveCompletionSnapshot *old = cmp->snapshot;
+
+  /* only the owning thread changes the completion, so a plain swap will
+   * do; readers still holding the old version keep it alive until they
+   * drop their reference */
+  cmp->snapshot = snapshot;
+
+  verve_completion_snapshot_unref (old);
+}
+
+
+static void
+verve_completion_index_insert (VerveCompletion *cmp,
+                               gpointer item)
+{
+  VerveCompletionSnapshot *old = cmp->snapshot;
+  VerveCompletionSnapshot *snapshot;
+  const gchar *str = verve_completion_item_string (cmp->func, item);
+  VerveFuzzyKey key;
+  guint lo = 0, hi = old->index->len, mid;
+
+  /* find the first item sorting after the new one */
+  while (lo < hi)
     {
-      plen = strlen (cmp->prefix);
-      if (plen <= len && !cmp->strncmp_func (prefix, cmp->prefix, plen))
-        {
-          /* use the cache */
-          list = cmp->cache;
-          while (list)
-            {
-              GList *next = list->next;
-
-              if (cmp->strncmp_func (prefix,
-                                     cmp->func ? cmp->func (list->data) : (gchar *) list->data,
-                                     len))
-                cmp->cache = g_list_delete_link (cmp->cache, list);
-
-              list = next;
-            }
-          done = TRUE;
-        }
+      mid = lo + (hi - lo) / 2;
+      if (strcmp (verve_completion_item_string (old->func, g_ptr_array_index (old->index, mid)), str) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
     }
 
-  if (!done)
+  /* copy the current version with the item put into place */
+  snapshot = verve_completion_snapshot_new (cmp->func, old->index->len + 1);
+
+  g_ptr_array_set_size (snapshot->index, old->index->len + 1);
+  memcpy (snapshot->index->pdata, old->index->pdata, lo * sizeof (gpointer));
+  snapshot->index->pdata[lo] = item;
+  memcpy (snapshot->index->pdata + lo + 1, old->index->pdata + lo, (old->index->len - lo) * sizeof (gpointer));
+
+  verve_fuzzy_key_init (&key, str);
+  g_array_append_vals (snapshot->keys, old->keys->data, lo);
+  g_array_append_val (snapshot->keys, key);
+  g_array_append_vals (snapshot->keys, &g_array_index (old->keys, VerveFuzzyKey, lo), old->keys->len - lo);
+
+  verve_trie_insert (cmp->trie, str);
+
+  verve_completion_publish (cmp, snapshot);
+}
+
+
+/* Merge-joins the items, which have to be sorted like the index, with the
+ * current version into a new one. With unique, items which are indexed
+ * already and duplicates among the new ones are dropped. */
+static void
+verve_completion_index_merge (VerveCompletion *cmp,
+                              gpointer *items,
+                              guint n_items,
+                              gboolean unique)
+{
+  VerveCompletionSnapshot *old = cmp->snapshot;
+  VerveCompletionSnapshot *merged;
+  const gchar *last = NULL;
+  guint i = 0, j = 0;
+
+  merged = verve_completion_snapshot_new (cmp->func, old->index->len + n_items);
+
+  while (i < old->index->len || j < n_items)
     {
-      /* normal code */
-      g_list_free (cmp->cache);
-      cmp->cache = NULL;
-      list = cmp->items;
-      while (*prefix && list)
+      gpointer item;
+      const gchar *str;
+      VerveFuzzyKey key;
+      gint result;
+
+      if (j == n_items)
+        result = -1;
+      else if (i == old->index->len)
+        result = 1;
+      else
+        result = strcmp (verve_completion_item_string (old->func, g_ptr_array_index (old->index, i)),
+                         verve_completion_item_string (cmp->func, items[j]));
+
+      /* equal items keep the order they were added in */
+      if (result < 0 || (result == 0 && !unique))
         {
-          if (!cmp->strncmp_func (prefix,
-                                  cmp->func ? cmp->func (list->data) : (gchar *) list->data,
-                                  len))
-            cmp->cache = g_list_prepend (cmp->cache, list->data);
-          list = list->next;
+          /* keep the indexed items, including their fuzzy matching data */
+          g_ptr_array_add (merged->index, g_ptr_array_index (old->index, i));
+          g_array_append_val (merged->keys, g_array_index (old->keys, VerveFuzzyKey, i));
+          i++;
+          continue;
         }
+
+      item = items[j++];
+      str = verve_completion_item_string (cmp->func, item);
+
+      if (unique && (result == 0 || (last && strcmp (last, str) == 0)))
+        continue;
+
+      verve_fuzzy_key_init (&key, str);
+      g_ptr_array_add (merged->index, item);
+      g_array_append_val (merged->keys, key);
+      last = str;
+
+      verve_trie_insert (cmp->trie, str);
+    }
+
+  verve_completion_publish (cmp, merged);
+}
+
+
+/* Returns a reference to the current version of the sorted index. Like all
+ * functions changing the completion, this has to be called from the thread
+ * owning it; the reference may then be handed to other threads, which can
+ * query the snapshot without any locking. */
+VerveCompletionSnapshot *
+verve_completion_get_snapshot (VerveCompletion *cmp)
+{
+  g_return_val_if_fail (cmp != NULL, NULL);
+
+  return verve_completion_snapshot_ref (cmp->snapshot);
+}
+
+
+/* Finds the items of the snapshot starting with prefix, without allocating
+ * anything. Returns the number of matches, which are the items first ...
+ * first + n - 1 of the sorted index in bytewise order. */
+guint
+verve_completion_snapshot_complete_range (VerveCompletionSnapshot *snapshot,
+                                          const gchar *prefix,
+                                          guint *first)
+{
+  gsize len;
+  guint lo, hi, mid;
+  guint start;
+
+  g_return_val_if_fail (snapshot != NULL, 0);
+  g_return_val_if_fail (prefix != NULL, 0);
+  g_return_val_if_fail (first != NULL, 0);
+
+  len = strlen (prefix);
+
+  /* lower bound: the first item not sorting before the prefix */
+  lo = 0;
+  hi = snapshot->index->len;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (strcmp (verve_completion_item_string (snapshot->func, g_ptr_array_index (snapshot->index, mid)), prefix) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  start = lo;
+
+  /* upper bound: the first item after that which doesn't start with the prefix */
+  hi = snapshot->index->len;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (strncmp (verve_completion_item_string (snapshot->func, g_ptr_array_index (snapshot->index, mid)), prefix, len) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  *first = start;
+  return lo - start;
+}
+
+
+static gint
+verve_completion_ranked_compare (gconstpointer a,
+                                 gconstpointer b)
+{
+  const VerveCompletionRanked *ra = a;
+  const VerveCompletionRanked *rb = b;
+
+  /* higher ranks first, equal ranks in bytewise order */
+  if (ra->rank != rb->rank)
+    return ra->rank > rb->rank ? -1 : 1;
+
+  return ra->index < rb->index ? -1 : (ra->index > rb->index);
+}
+
+
+/* Replaces the contents of results with the items starting with prefix,
+ * ordered by the rank function (bytewise without one). Returns the
+ * number of results. */
+guint
+verve_completion_complete_ranked (VerveCompletion *cmp,
+                                  const gchar *prefix,
+                                  GPtrArray *results)
+{
+  VerveCompletionSnapshot *snapshot;
+  guint first, n, i;
+
+  g_return_val_if_fail (cmp != NULL, 0);
+  g_return_val_if_fail (prefix != NULL, 0);
+  g_return_val_if_fail (results != NULL, 0);
+
+  snapshot = verve_completion_get_snapshot (cmp);
+  n = verve_completion_snapshot_complete_range (snapshot, prefix, &first);
+
+  g_ptr_array_set_size (results, 0);
+
+  if (!cmp->rank_func)
+    {
+      for (i = 0; i < n; i++)
+        g_ptr_array_add (results, g_ptr_array_index (snapshot->index, first + i));
+      verve_completion_snapshot_unref (snapshot);
+      return n;
+    }
+
+  /* rank the range in the reused scratch array */
+  g_array_set_size (cmp->ranked, n);
+  for (i = 0; i < n; i++)
+    {
+      VerveCompletionRanked *ranked = &g_array_index (cmp->ranked, VerveCompletionRanked, i);
+
+      ranked->index = first + i;
+      ranked->rank = cmp->rank_func (g_ptr_array_index (snapshot->index, first + i));
     }
-  if (cmp->prefix)
+
+  g_array_sort (cmp->ranked, verve_completion_ranked_compare);
+
+  for (i = 0; i < n; i++)
+    g_ptr_array_add (results, g_ptr_array_index (snapshot->index, g_array_index (cmp->ranked, VerveCompletionRanked, i).index));
+
+  verve_completion_snapshot_unref (snapshot);
+
+  return n;
+}
+
+
+/* Finds the items containing the characters of pattern in order (ignoring
+ * ASCII case) and stores the max_results best of them in results, best
+ * first. Returns the number of results stored. */
+guint
+verve_completion_complete_fuzzy (VerveCompletion *cmp,
+                                 const gchar *pattern,
+                                 gpointer *results,
+                                 guint max_results)
+{
+  VerveCompletionSnapshot *snapshot;
+  VerveFuzzyMatch *heap;
+  VerveFuzzyKey pattern_key;
+  guint n_matches = 0;
+  guint i;
+
+  g_return_val_if_fail (cmp != NULL, 0);
+  g_return_val_if_fail (pattern != NULL, 0);
+  g_return_val_if_fail (results != NULL || max_results == 0, 0);
+  g_return_val_if_fail (max_results <= 256, 0);
+
+  snapshot = verve_completion_get_snapshot (cmp);
+
+  verve_fuzzy_key_init (&pattern_key, pattern);
+  heap = g_newa (VerveFuzzyMatch, MAX (max_results, 1));
+
+  for (i = 0; i < snapshot->index->len; i++)
     {
-      g_free (cmp->prefix);
-      cmp->prefix = NULL;
+      const VerveFuzzyKey *key = &g_array_index (snapshot->keys, VerveFuzzyKey, i);
+      VerveFuzzyMatch match;
+
+      /* cheap rejection by character classes */
+      if (!verve_fuzzy_may_match (&pattern_key, key))
+        continue;
+
+      match.score = verve_fuzzy_score (pattern, pattern_key.length,
+                                       verve_completion_item_string (snapshot->func, g_ptr_array_index (snapshot->index, i)),
+                                       key->length);
+      if (match.score == VERVE_FUZZY_NO_MATCH)
+        continue;
+
+      /* keep the best matches only */
+      match.length = key->length;
+      match.index = i;
+      verve_fuzzy_heap_push (heap, &n_matches, max_results, &match);
     }
-  if (cmp->cache)
-    cmp->prefix = g_strdup (prefix);
 
-  return *prefix ? cmp->cache : cmp->items;
+  verve_fuzzy_heap_sort (heap, n_matches);
+
+  for (i = 0; i < n_matches; i++)
+    results[i] = g_ptr_array_index (snapshot->index, heap[i].index);
+
+  verve_completion_snapshot_unref (snapshot);
+
+  return n_matches;
+}
+
+
+static void
+verve_completion_similar_found (const gchar *key,
+                                guint distance,
+                                gpointer user_data)
+{
+  VerveCompletionSimilarSearch *search = user_data;
+  VerveCompletionSimilar match;
+  guint first;
+
+  /* the item itself is the first one starting with its string */
+  if (!verve_completion_snapshot_complete_range (search->snapshot, key, &first))
+    return;
+
+  match.distance = distance;
+  match.index = first;
+  match.rank = search->cmp->rank_func
+    ? search->cmp->rank_func (g_ptr_array_index (search->snapshot->index, first))
+    : 0.0;
+
+  g_array_append_val (search->matches, match);
+}
+
+
+static gint
+verve_completion_similar_compare (gconstpointer a,
+                                  gconstpointer b)
+{
+  const VerveCompletionSimilar *sa = a;
+  const VerveCompletionSimilar *sb = b;
+
+  /* fewer edits first, then higher ranks, then bytewise order */
+  if (sa->distance != sb->distance)
+    return sa->distance < sb->distance ? -1 : 1;
+
+  if (sa->rank != sb->rank)
+    return sa->rank > sb->rank ? -1 : 1;
+
+  return sa->index < sb->index ? -1 : (sa->index > sb->index);
+}
+
+
+/* Finds the items which differ from word by at most max_distance byte
+ * insertions, deletions and substitutions, without comparing word to
+ * each of them, and stores the max_results best of them in results,
+ * closest first. Returns the number of results stored. */
+guint
+verve_completion_complete_similar (VerveCompletion *cmp,
+                                   const gchar *word,
+                                   guint max_distance,
+                                   gpointer *results,
+                                   guint max_results)
+{
+  VerveCompletionSimilarSearch search;
+  guint n, i;
+
+  g_return_val_if_fail (cmp != NULL, 0);
+  g_return_val_if_fail (word != NULL, 0);
+  g_return_val_if_fail (results != NULL || max_results == 0, 0);
+
+  search.cmp = cmp;
+  search.snapshot = verve_completion_get_snapshot (cmp);
+  search.matches = g_array_new (FALSE, FALSE, sizeof (VerveCompletionSimilar));
+
+  /* the trie walk visits only the strings the automaton can still accept */
+  verve_trie_find_similar (cmp->trie, word, max_distance, verve_completion_similar_found, &search);
+
+  g_array_sort (search.matches, verve_completion_similar_compare);
+
+  n = MIN (search.matches->len, max_results);
+  for (i = 0; i < n; i++)
+    results[i] = g_ptr_array_index (search.snapshot->index, g_array_index (search.matches, VerveCompletionSimilar, i).index);
+
+  g_array_free (search.matches, TRUE);
+  verve_completion_snapshot_unref (search.snapshot);
+
+  return n;
+}
+
+
+/* Returns the longest prefix shared by all items starting with prefix,
+ * cut to whole UTF-8 characters, or NULL if there are no such items. */
+gchar *
+verve_completion_get_common_prefix (VerveCompletion *cmp,
+                                    const gchar *prefix)
+{
+  const gchar *end;
+  gchar *result;
+
+  g_return_val_if_fail (cmp != NULL, NULL);
+  g_return_val_if_fail (prefix != NULL, NULL);
+
+  result = verve_trie_common_prefix (cmp->trie, prefix);
+
+  /* the trie works on bytes, don't end in the middle of a character */
+  if (result && !g_utf8_validate (result, -1, &end))
+    result[MAX ((gsize) (end - result), strlen (prefix))] = '\0';
+
+  return result;
 }
 
 
@@ -147,6 +693,8 @@ verve_completion_free (VerveCompletion *cmp)
 {
   g_return_if_fail (cmp != NULL);
 
-  verve_completion_clear_items (cmp);
+  verve_completion_snapshot_unref (cmp->snapshot);
+  g_array_free (cmp->ranked, TRUE);
+  verve_trie_free (cmp->trie);
   g_free (cmp);
 }
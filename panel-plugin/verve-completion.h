@@ -21,36 +21,81 @@
 
 #include <glib.h>
 
+#include "verve-fuzzy.h"
+#include "verve-trie.h"
+
 G_BEGIN_DECLS
 
 typedef struct _VerveCompletion VerveCompletion;
+typedef struct _VerveCompletionSnapshot VerveCompletionSnapshot;
 
 typedef gchar *(*VerveCompletionFunc) (gpointer item);
 
-typedef gint (*VerveCompletionStrncmpFunc) (const gchar *s1,
-                                            const gchar *s2,
-                                            gsize n);
+typedef gdouble (*VerveCompletionRankFunc) (gpointer item);
 
 struct _VerveCompletion
 {
-  GList *items;
   VerveCompletionFunc func;
 
-  gchar *prefix;
-  GList *cache;
-  VerveCompletionStrncmpFunc strncmp_func;
+  /* immutable sorted index, replaced by a new version after changes */
+  VerveCompletionSnapshot *snapshot;
+
+  /* radix trie of the item strings, updated in place */
+  VerveTrie *trie;
+
+  /* ranks results of verve_completion_complete_ranked (), higher first */
+  VerveCompletionRankFunc rank_func;
+  GArray *ranked;
 };
 
 VerveCompletion *
 verve_completion_new (VerveCompletionFunc func);
 void
+verve_completion_set_rank_func (VerveCompletion *cmp,
+                                VerveCompletionRankFunc rank_func);
+void
 verve_completion_add_items (VerveCompletion *cmp,
                             GList *items);
 void
+verve_completion_merge_items (VerveCompletion *cmp,
+                              GList *items);
+void
+verve_completion_merge_sorted_items (VerveCompletion *cmp,
+                                     gpointer *items,
+                                     guint n_items);
+void
+verve_completion_remove_items (VerveCompletion *cmp,
+                               GList *items);
+void
 verve_completion_clear_items (VerveCompletion *cmp);
-GList *
-verve_completion_complete (VerveCompletion *cmp,
-                           const gchar *prefix);
+VerveCompletionSnapshot *
+verve_completion_get_snapshot (VerveCompletion *cmp);
+VerveCompletionSnapshot *
+verve_completion_snapshot_ref (VerveCompletionSnapshot *snapshot);
+void
+verve_completion_snapshot_unref (VerveCompletionSnapshot *snapshot);
+guint
+verve_completion_snapshot_complete_range (VerveCompletionSnapshot *snapshot,
+                                          const gchar *prefix,
+                                          guint *first);
+guint
+verve_completion_complete_ranked (VerveCompletion *cmp,
+                                  const gchar *prefix,
+                                  GPtrArray *results);
+guint
+verve_completion_complete_fuzzy (VerveCompletion *cmp,
+                                 const gchar *pattern,
+                                 gpointer *results,
+                                 guint max_results);
+guint
+verve_completion_complete_similar (VerveCompletion *cmp,
+                                   const gchar *word,
+                                   guint max_distance,
+                                   gpointer *results,
+                                   guint max_results);
+gchar *
+verve_completion_get_common_prefix (VerveCompletion *cmp,
+                                    const gchar *prefix);
 void
 verve_completion_free (VerveCompletion *cmp);
 G_END_DECLS
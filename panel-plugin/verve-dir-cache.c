@@ -0,0 +1,412 @@
+/***************************************************************************
+ *            verve-dir-cache.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "verve-dir-cache.h"
+
+
+
+/*********************************************************************
+ *
+ * Directory listing cache
+ * -----------------------
+ *
+ * Filename completion needs the entries of the directory an argument
+ * points into. Directories are listed in a worker thread and the
+ * listings are kept in a least recently used cache, keyed by the path
+ * and validated by the modification time of the directory.
+ *
+ * Lookups never touch the disk. A listing which has not been checked
+ * for VERVE_DIR_CACHE_CHECK_INTERVAL is still returned, but the caller
+ * is asked to load it again in the background. That load only queries
+ * the modification time as long as the directory does not change.
+ *
+ *********************************************************************/
+
+/* Time a listing is used for without checking the directory again */
+#define VERVE_DIR_CACHE_CHECK_INTERVAL (2 * G_TIME_SPAN_SECOND)
+
+/* Attributes needed to check and to list a directory */
+#define VERVE_DIR_CACHE_TIME_ATTRIBUTES  G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+#define VERVE_DIR_CACHE_ENTRY_ATTRIBUTES G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE
+
+
+
+static VerveDirListing *verve_dir_listing_new       (const gchar     *path,
+                                                     gint64           mtime);
+static VerveDirListing *verve_dir_listing_ref       (VerveDirListing *listing);
+static void             verve_dir_listing_unref     (gpointer         data);
+static void             verve_dir_cache_remove      (VerveDirCache   *cache,
+                                                     VerveDirListing *listing);
+static void             verve_dir_cache_load_free   (gpointer         data);
+static void             verve_dir_cache_load_thread (GTask           *task,
+                                                     gpointer         source_object,
+                                                     gpointer         task_data,
+                                                     GCancellable    *cancellable);
+
+
+
+struct _VerveDirListing
+{
+  gint             ref_count;
+
+  gchar           *path;
+
+  /* Modification time of the directory in microseconds, and the
+   * (monotonic) time it was last compared to the directory */
+  gint64           mtime;
+  gint64           checked;
+
+  /* Entry names, those of directories end with a slash */
+  GPtrArray       *names;
+  VerveCompletion *completion;
+
+  /* Link in the LRU queue of the cache */
+  GList            link;
+};
+
+
+
+struct _VerveDirCache
+{
+  guint       max_listings;
+
+  /* Path -> listing */
+  GHashTable *listings;
+
+  /* Listings, most recently used first */
+  GQueue      lru;
+};
+
+
+
+/* Data of a load running in the worker thread */
+typedef struct
+{
+  gchar           *path;
+
+  /* Listing cached when the load was started, kept if the directory did not change */
+  VerveDirListing *cached;
+} VerveDirLoad;
+
+
+
+static VerveDirListing *
+verve_dir_listing_new (const gchar *path,
+                       gint64       mtime)
+{
+  VerveDirListing *listing;
+
+  listing = g_new0 (VerveDirListing, 1);
+  listing->ref_count = 1;
+  listing->path = g_strdup (path);
+  listing->mtime = mtime;
+  listing->names = g_ptr_array_new_with_free_func (g_free);
+  listing->completion = verve_completion_new (NULL);
+  listing->link.data = listing;
+
+  return listing;
+}
+
+
+
+static VerveDirListing *
+verve_dir_listing_ref (VerveDirListing *listing)
+{
+  g_atomic_int_inc (&listing->ref_count);
+
+  return listing;
+}
+
+
+
+static void
+verve_dir_listing_unref (gpointer data)
+{
+  VerveDirListing *listing = data;
+
+  if (!g_atomic_int_dec_and_test (&listing->ref_count))
+    return;
+
+  /* The completion refers to the names, free it first */
+  verve_completion_free (listing->completion);
+  g_ptr_array_free (listing->names, TRUE);
+  g_free (listing->path);
+  g_free (listing);
+}
+
+
+
+VerveCompletion *
+verve_dir_listing_get_completion (VerveDirListing *listing)
+{
+  return listing->completion;
+}
+
+
+
+VerveDirCache *
+verve_dir_cache_new (guint max_listings)
+{
+  VerveDirCache *cache;
+
+  cache = g_new0 (VerveDirCache, 1);
+  cache->max_listings = MAX (max_listings, 1);
+  cache->listings = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&cache->lru);
+
+  return cache;
+}
+
+
+
+void
+verve_dir_cache_free (VerveDirCache *cache)
+{
+  if (cache == NULL)
+    return;
+
+  /* Drop all listings, loads still running hold their own references */
+  while (cache->lru.head != NULL)
+    verve_dir_cache_remove (cache, cache->lru.head->data);
+
+  g_hash_table_destroy (cache->listings);
+  g_free (cache);
+}
+
+
+
+static void
+verve_dir_cache_remove (VerveDirCache   *cache,
+                        VerveDirListing *listing)
+{
+  g_hash_table_remove (cache->listings, listing->path);
+  g_queue_unlink (&cache->lru, &listing->link);
+  verve_dir_listing_unref (listing);
+}
+
+
+
+VerveDirListing *
+verve_dir_cache_lookup (VerveDirCache *cache,
+                        const gchar   *path,
+                        gboolean      *needs_check)
+{
+  VerveDirListing *listing;
+
+  listing = g_hash_table_lookup (cache->listings, path);
+
+  if (listing == NULL)
+    return NULL;
+
+  /* Mark the listing as the most recently used one */
+  g_queue_unlink (&cache->lru, &listing->link);
+  g_queue_push_head_link (&cache->lru, &listing->link);
+
+  /* Ask for a background check if the directory may have changed in the meantime */
+  if (needs_check != NULL)
+    *needs_check = (g_get_monotonic_time () - listing->checked >= VERVE_DIR_CACHE_CHECK_INTERVAL);
+
+  return listing;
+}
+
+
+
+void
+verve_dir_cache_load_async (VerveDirCache       *cache,
+                            const gchar         *path,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  VerveDirListing *cached;
+  VerveDirLoad    *load;
+  GTask           *task;
+
+  load = g_new0 (VerveDirLoad, 1);
+  load->path = g_strdup (path);
+
+  /* Pass the cached listing along, it is kept if the directory did not change */
+  cached = g_hash_table_lookup (cache->listings, path);
+  if (cached != NULL)
+    load->cached = verve_dir_listing_ref (cached);
+
+  /* List the directory in a worker thread */
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_task_data (task, load, verve_dir_cache_load_free);
+  g_task_run_in_thread (task, verve_dir_cache_load_thread);
+  g_object_unref (task);
+}
+
+
+
+/* Returns the loaded listing, or NULL if loading failed or was cancelled */
+VerveDirListing *
+verve_dir_cache_load_finish (GAsyncResult  *result,
+                             GError       **error)
+{
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+
+
+/* Puts a loaded listing into the cache, which takes over the reference */
+void
+verve_dir_cache_insert (VerveDirCache   *cache,
+                        VerveDirListing *listing)
+{
+  VerveDirListing *existing;
+
+  listing->checked = g_get_monotonic_time ();
+
+  existing = g_hash_table_lookup (cache->listings, listing->path);
+
+  if (existing == listing)
+    {
+      /* The directory did not change, the cache already holds a reference */
+      verve_dir_listing_unref (listing);
+      g_queue_unlink (&cache->lru, &listing->link);
+    }
+  else
+    {
+      /* Replace the outdated listing */
+      if (existing != NULL)
+        verve_dir_cache_remove (cache, existing);
+
+      g_hash_table_insert (cache->listings, listing->path, listing);
+    }
+
+  g_queue_push_head_link (&cache->lru, &listing->link);
+
+  /* Forget the least recently used listings */
+  while (cache->lru.length > cache->max_listings)
+    verve_dir_cache_remove (cache, cache->lru.tail->data);
+}
+
+
+
+static void
+verve_dir_cache_load_free (gpointer data)
+{
+  VerveDirLoad *load = data;
+
+  if (load->cached != NULL)
+    verve_dir_listing_unref (load->cached);
+
+  g_free (load->path);
+  g_free (load);
+}
+
+
+
+static void
+verve_dir_cache_load_thread (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  VerveDirLoad    *load = task_data;
+  VerveDirListing *listing;
+  GFileEnumerator *enumerator;
+  GFileInfo       *info;
+  GError          *error = NULL;
+  GFile           *file;
+  GList           *items = NULL;
+  gint64           mtime;
+  guint            i;
+
+  file = g_file_new_for_path (load->path);
+
+  /* Check the modification time first */
+  info = g_file_query_info (file, VERVE_DIR_CACHE_TIME_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, cancellable, &error);
+
+  if (G_UNLIKELY (info == NULL))
+    {
+      g_task_return_error (task, error);
+      g_object_unref (file);
+      return;
+    }
+
+  mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+          + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  g_object_unref (info);
+
+  /* Keep the cached listing if the directory did not change */
+  if (load->cached != NULL && load->cached->mtime == mtime)
+    {
+      g_task_return_pointer (task, verve_dir_listing_ref (load->cached), verve_dir_listing_unref);
+      g_object_unref (file);
+      return;
+    }
+
+  enumerator = g_file_enumerate_children (file, VERVE_DIR_CACHE_ENTRY_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, cancellable, &error);
+  g_object_unref (file);
+
+  if (G_UNLIKELY (enumerator == NULL))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  listing = verve_dir_listing_new (load->path, mtime);
+
+  /* Collect the entry names, symlinks to directories count as directories */
+  while ((info = g_file_enumerator_next_file (enumerator, cancellable, &error)) != NULL)
+    {
+      const gchar *name = g_file_info_get_name (info);
+
+      /* The input entry can only show UTF-8 names */
+      if (G_LIKELY (g_utf8_validate (name, -1, NULL)))
+        {
+          if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+            g_ptr_array_add (listing->names, g_strconcat (name, "/", NULL));
+          else
+            g_ptr_array_add (listing->names, g_strdup (name));
+        }
+
+      g_object_unref (info);
+    }
+
+  g_file_enumerator_close (enumerator, NULL, NULL);
+  g_object_unref (enumerator);
+
+  if (G_UNLIKELY (error != NULL))
+    {
+      verve_dir_listing_unref (listing);
+      g_task_return_error (task, error);
+      return;
+    }
+
+  /* Fill the completion, which builds its index here rather than on the first Tab */
+  for (i = listing->names->len; i > 0; i--)
+    items = g_list_prepend (items, g_ptr_array_index (listing->names, i - 1));
+
+  verve_completion_add_items (listing->completion, items);
+  g_list_free (items);
+
+  g_task_return_pointer (task, listing, verve_dir_listing_unref);
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,57 @@
+/***************************************************************************
+ *            verve-dir-cache.h
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __VERVE_DIR_CACHE_H__
+#define __VERVE_DIR_CACHE_H__
+
+#include <gio/gio.h>
+
+#include "verve-completion.h"
+
+G_BEGIN_DECLS;
+
+typedef struct _VerveDirCache   VerveDirCache;
+typedef struct _VerveDirListing VerveDirListing;
+
+VerveDirCache   *verve_dir_cache_new              (guint                max_listings);
+void             verve_dir_cache_free             (VerveDirCache       *cache);
+
+VerveDirListing *verve_dir_cache_lookup           (VerveDirCache       *cache,
+                                                   const gchar         *path,
+                                                   gboolean            *needs_check);
+void             verve_dir_cache_load_async       (VerveDirCache       *cache,
+                                                   const gchar         *path,
+                                                   GCancellable        *cancellable,
+                                                   GAsyncReadyCallback  callback,
+                                                   gpointer             user_data);
+VerveDirListing *verve_dir_cache_load_finish      (GAsyncResult        *result,
+                                                   GError             **error);
+void             verve_dir_cache_insert           (VerveDirCache       *cache,
+                                                   VerveDirListing     *listing);
+
+VerveCompletion *verve_dir_listing_get_completion (VerveDirListing     *listing);
+
+G_END_DECLS;
+
+#endif /* !__VERVE_DIR_CACHE_H__ */
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
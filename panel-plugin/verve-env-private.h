@@ -0,0 +1,45 @@
+/***************************************************************************
+ *            verve-env-private.h
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __VERVE_ENV_PRIVATE_H__
+#define __VERVE_ENV_PRIVATE_H__
+
+#include "verve-env.h"
+
+G_BEGIN_DECLS;
+
+/* Hooks for the tests and benchmarks. They only exist if verve-env.c is
+ * built with VERVE_ENV_TESTING defined, the plugin never is */
+#ifdef VERVE_ENV_TESTING
+void    verve_env_test_set_stall       (guint      stall);
+gchar **verve_env_test_add_names       (VerveEnv  *env,
+                                        GPtrArray *names);
+void    verve_env_test_get_scan_counts (VerveEnv  *env,
+                                        guint     *n_entries,
+                                        guint     *n_syscalls);
+#endif
+
+G_END_DECLS;
+
+#endif /* __VERVE_ENV_PRIVATE_H__ */
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -21,7 +21,29 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <gio/gio.h>
+
 #include "verve-env.h"
+#include "verve-env-private.h"
+#include "verve-cache.h"
+
+
+
+/* Maximum number of threads used to read $PATH directories */
+#define VERVE_ENV_MAX_SCAN_THREADS 4
+
+/* Time the main loop may spend on delivering loader results per iteration */
+#define VERVE_ENV_DELIVERY_BUDGET  (4 * G_TIME_SPAN_MILLISECOND)
+
+/* Default time to wait for the loading thread on shutdown, in milliseconds */
+#define VERVE_ENV_SHUTDOWN_TIMEOUT 500
 
 
 
@@ -30,8 +52,43 @@ static void     verve_env_class_init             (gpointer       g_class,
 static void     verve_env_init                   (GTypeInstance *instance,
                                                   gpointer       g_class);
 static void     verve_env_finalize               (GObject       *object);
+static void     verve_env_stop_loading           (VerveEnv      *env);
 static void     verve_env_load_binaries          (VerveEnv      *env);
+static guint    verve_env_binary_hash            (gconstpointer  key);
+static gboolean verve_env_binary_equal           (gconstpointer  a,
+                                                  gconstpointer  b);
+static gint     verve_env_binary_compare         (gconstpointer  a,
+                                                  gconstpointer  b);
+static GArray  *verve_env_add_binaries           (VerveEnv      *env,
+                                                  GArray        *binaries,
+                                                  GPtrArray     *names,
+                                                  gchar       ***added);
+static void     verve_env_set_binaries           (VerveEnv      *env,
+                                                  GArray        *binaries);
+static gchar   *verve_env_display_name           (const gchar   *name);
+static GPtrArray *verve_env_scan_directory       (VerveEnv      *env,
+                                                  const gchar   *path,
+                                                  guint         *n_entries,
+                                                  guint         *n_syscalls);
+static void     verve_env_scan_job               (gpointer       data,
+                                                  gpointer       user_data);
 static gpointer verve_env_load_thread            (gpointer       user_data);
+static void     verve_env_deliver                (VerveEnv      *env,
+                                                  GArray        *binaries,
+                                                  gchar        **added);
+static gboolean verve_env_delivery_dispatch      (GSource       *source,
+                                                  GSourceFunc    callback,
+                                                  gpointer       user_data);
+static gboolean verve_env_process_deliveries     (gpointer       user_data);
+static void     verve_env_delivery_free          (gpointer       data);
+static void     verve_env_start_monitors         (VerveEnv      *env);
+static gboolean verve_env_is_binary              (VerveEnv      *env,
+                                                  const gchar   *basename);
+static void     verve_env_monitor_changed        (GFileMonitor      *monitor,
+                                                  GFile             *file,
+                                                  GFile             *other_file,
+                                                  GFileMonitorEvent  event_type,
+                                                  VerveEnv          *env);
 
 
 
@@ -40,34 +97,138 @@ struct _VerveEnvClass
   GObjectClass __parent__;
 
   guint        load_binaries_signal;
+  guint        binaries_changed_signal;
 
   /* Signals */
-  void (*load_binaries) (VerveEnv *env);
+  void (*load_binaries)    (VerveEnv *env);
+  void (*binaries_changed) (VerveEnv *env,
+                            gchar   **added,
+                            gchar   **removed);
 };
 
 
 
 struct _VerveEnv
 {
-  GObject  __parent__;
+  GObject     __parent__;
 
   /* $PATH list */
-  gchar  **paths;
+  gchar     **paths;
+
+  /* Distinct, readable $PATH directories (pointing into paths) */
+  GPtrArray  *directories;
+
+  /* Binaries in $PATH, array of VerveEnvBinary sorted bytewise by name. Only
+   * used from the main loop and never modified once set, changes replace the array */
+  GArray     *binaries;
+
+  /* Blocks of binary names stored back to back, one per batch of added binaries */
+  GPtrArray  *arenas;
+
+  /* List returned by verve_env_get_path_binaries (), built on demand */
+  GList      *binaries_list;
+
+  /* Set of binary names, the keys are owned by the arenas */
+  GHashTable *index;
+
+  /* Thread used for loading $PATH binary names. It holds a reference on
+   * the environment and sets load_finished right before it exits */
+  GThread      *load_thread;
+  GCancellable *load_cancellable;
+  GMutex        load_mutex;
+  GCond         load_cond;
+  gboolean      load_finished;
+
+  /* Time to wait for the loading thread on shutdown, in milliseconds */
+  guint         shutdown_timeout;
+
+  /* Directory entries read and file system calls made by the last scan */
+  guint         n_scanned_entries;
+  guint         n_scan_syscalls;
+
+#if defined (HAVE_DIRFD) && defined (HAVE_FACCESSAT) && defined (HAVE_FSTATAT)
+  /* Credentials the permissions of symlinked binaries are checked against */
+  uid_t         euid;
+  gid_t         egid;
+  gid_t        *groups;
+  gint          n_groups;
+#endif
+
+  /* Results of the loading thread waiting to be handed to the main loop */
+  GAsyncQueue *deliveries;
+  GSource     *delivery_source;
+
+  /* Directory monitors, set up once the binaries have been loaded */
+  GPtrArray  *monitors;
+};
+
+
+
+/* A binary name inside one of the arenas */
+typedef struct
+{
+  const gchar *name;
+  gsize        length;
+} VerveEnvBinary;
+
+
+
+/* Result of the loading thread, handed over to the main loop */
+typedef struct
+{
+  /* Binaries known after this batch, NULL once loading is finished */
+  GArray  *binaries;
+
+  /* Names added by this batch */
+  gchar  **added;
+} VerveEnvDelivery;
 
-  /* Binaries in $PATH */
-  GList   *binaries;
 
-  /* Thread used for loading $PATH binary names */
-  gboolean load_thread_cancelled;
-  GThread *load_thread;
+
+/* A source which is dispatched whenever its ready time is reached */
+static GSourceFuncs verve_env_delivery_funcs =
+{
+  NULL,
+  NULL,
+  verve_env_delivery_dispatch,
+  NULL,
+  NULL,
+  NULL,
 };
 
 
 
+/* A single $PATH directory to be read by the scanner thread pool */
+typedef struct
+{
+  VerveEnv      *env;
+  VerveCache    *cache;
+  VerveCacheDir  dir;
+
+  /* Queue the job is pushed onto when it is done */
+  GAsyncQueue   *done;
+
+  /* Whether the directory had to be scanned (i.e. was not cached) */
+  gboolean       scanned;
+
+  /* Entries read and file system calls made while scanning */
+  guint          n_entries;
+  guint          n_syscalls;
+} VerveEnvScanJob;
+
+
+
 static GObjectClass *verve_env_parent_class;
 
 
 
+#ifdef VERVE_ENV_TESTING
+/* Time every scanner stalls before reading its directory, in milliseconds */
+static gint verve_env_test_stall = 0;
+#endif
+
+
+
 GType
 verve_env_get_type (void)
 {
@@ -120,6 +281,22 @@ verve_env_class_init (gpointer g_class,
                                               g_cclosure_marshal_VOID__VOID,
                                               G_TYPE_NONE,
                                               0);
+
+  /* Register "binaries-changed" signal, emitted for every batch of binaries
+   * found while loading and for changes in $PATH afterwards. The added names
+   * are sorted bytewise, like strcmp () does. All names are owned by the
+   * environment and stay valid as long as it exists. Both signals are only
+   * emitted from the main loop */
+  klass->binaries_changed_signal = g_signal_new ("binaries-changed",
+                                                 G_TYPE_FROM_CLASS (klass),
+                                                 G_SIGNAL_RUN_LAST,
+                                                 G_STRUCT_OFFSET (VerveEnvClass, binaries_changed),
+                                                 NULL, NULL,
+                                                 g_cclosure_marshal_generic,
+                                                 G_TYPE_NONE,
+                                                 2,
+                                                 G_TYPE_STRV | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                                 G_TYPE_STRV | G_SIGNAL_TYPE_STATIC_SCOPE);
 }
 
 
@@ -131,15 +308,47 @@ verve_env_init (GTypeInstance *instance,
   VerveEnv *env = VERVE_ENV (instance);
 
   env->paths = NULL;
-  env->binaries = NULL;
+  env->directories = g_ptr_array_new ();
+  env->binaries = g_array_new (FALSE, FALSE, sizeof (VerveEnvBinary));
+  env->arenas = g_ptr_array_new_with_free_func (g_free);
+  env->binaries_list = NULL;
+  env->index = g_hash_table_new (verve_env_binary_hash, verve_env_binary_equal);
+
+  env->deliveries = g_async_queue_new_full (verve_env_delivery_free);
+  env->monitors = g_ptr_array_new_with_free_func (g_object_unref);
+
+  /* Results of the loading thread are processed in the main loop, after
+   * user input. The loading thread wakes the source up by setting its ready time */
+  env->delivery_source = g_source_new (&verve_env_delivery_funcs, sizeof (GSource));
+  g_source_set_priority (env->delivery_source, G_PRIORITY_DEFAULT_IDLE);
+  g_source_set_callback (env->delivery_source, verve_env_process_deliveries, env, NULL);
+  g_source_attach (env->delivery_source, NULL);
+
+  env->load_cancellable = g_cancellable_new ();
+  g_mutex_init (&env->load_mutex);
+  g_cond_init (&env->load_cond);
+  env->load_finished = FALSE;
+  env->shutdown_timeout = VERVE_ENV_SHUTDOWN_TIMEOUT;
+  env->n_scanned_entries = 0;
+  env->n_scan_syscalls = 0;
+
+#if defined (HAVE_DIRFD) && defined (HAVE_FACCESSAT) && defined (HAVE_FSTATAT)
+  /* Look the credentials up once instead of asking the kernel for every binary */
+  env->euid = geteuid ();
+  env->egid = getegid ();
+  env->n_groups = getgroups (0, NULL);
+  env->groups = g_new (gid_t, MAX (env->n_groups, 1));
+  env->n_groups = getgroups (env->n_groups, env->groups);
+#endif
 
   /* Spawn the thread used to load the command completion data */
-  env->load_thread = g_thread_new (NULL, verve_env_load_thread, env);
+  env->load_thread = g_thread_new (NULL, verve_env_load_thread, g_object_ref (env));
 }
 
 
 
 static VerveEnv *global_env = NULL;
+static guint     global_env_users = 0;
 
 
 
@@ -153,6 +362,8 @@ verve_env_get (void)
     }
   else
     g_object_ref (G_OBJECT (global_env));
+
+  global_env_users++;
   
   return global_env;
 }
@@ -162,8 +373,69 @@ verve_env_get (void)
 void 
 verve_env_shutdown (void)
 {
-  if (G_LIKELY (global_env != NULL))
-    g_object_unref (G_OBJECT (global_env));
+  VerveEnv *env = global_env;
+
+  if (G_UNLIKELY (env == NULL))
+    return;
+
+  /* Stop loading when the last user is gone, a later verve_env_get ()
+   * creates a new environment even if the thread is still running */
+  if (--global_env_users == 0)
+    {
+      g_object_remove_weak_pointer (G_OBJECT (env), (gpointer) &global_env);
+      global_env = NULL;
+
+      verve_env_stop_loading (env);
+    }
+
+  g_object_unref (G_OBJECT (env));
+}
+
+
+
+void
+verve_env_set_shutdown_timeout (VerveEnv *env,
+                                guint     timeout)
+{
+  env->shutdown_timeout = timeout;
+}
+
+
+
+static void
+verve_env_stop_loading (VerveEnv *env)
+{
+  gboolean finished;
+  gint64   deadline;
+
+  /* Ask the loading thread and its scanners to stop */
+  g_cancellable_cancel (env->load_cancellable);
+
+  /* Nothing is delivered to the main loop anymore */
+  g_source_destroy (env->delivery_source);
+
+  /* Wait for the thread, but not forever. Reading a directory on a stale
+   * network mount may block in the kernel and can't be interrupted */
+  deadline = g_get_monotonic_time () + env->shutdown_timeout * G_TIME_SPAN_MILLISECOND;
+
+  g_mutex_lock (&env->load_mutex);
+  while (!env->load_finished)
+    if (!g_cond_wait_until (&env->load_cond, &env->load_mutex, deadline))
+      break;
+  finished = env->load_finished;
+  g_mutex_unlock (&env->load_mutex);
+
+  if (G_LIKELY (finished))
+    g_thread_join (env->load_thread);
+  else
+    {
+      /* Detach the thread, its reference keeps the environment alive until it returns */
+      g_warning ("Loading $PATH binaries did not finish within %u ms, detaching the loader thread",
+                 env->shutdown_timeout);
+      g_thread_unref (env->load_thread);
+    }
+
+  env->load_thread = NULL;
 }
 
 
@@ -172,21 +444,42 @@ static void
 verve_env_finalize (GObject *object)
 {
   VerveEnv *env = VERVE_ENV (object);
+  guint     i;
+
+  /* Join the loading thread if verve_env_shutdown () did not do that */
+  if (env->load_thread != NULL)
+    g_thread_join (env->load_thread);
+
+  g_object_unref (env->load_cancellable);
+  g_mutex_clear (&env->load_mutex);
+  g_cond_clear (&env->load_cond);
+
+#if defined (HAVE_DIRFD) && defined (HAVE_FACCESSAT) && defined (HAVE_FSTATAT)
+  g_free (env->groups);
+#endif
 
-  /* Cancel and join the loading thread */
-  env->load_thread_cancelled = TRUE;
-  g_thread_join (env->load_thread);
+  /* Drop results which have not been delivered yet */
+  g_source_destroy (env->delivery_source);
+  g_source_unref (env->delivery_source);
+  g_async_queue_unref (env->deliveries);
+
+  /* Stop watching directories */
+  for (i = 0; i < env->monitors->len; i++)
+    g_file_monitor_cancel (g_ptr_array_index (env->monitors, i));
+  g_ptr_array_unref (env->monitors);
+
+  /* Free binary name index */
+  g_hash_table_destroy (env->index);
 
   /* Free path list */
+  g_ptr_array_unref (env->directories);
   if (G_LIKELY (env->paths != NULL))
     g_strfreev (env->paths);
 
-  /* Free binaries list */
-  if (G_LIKELY (env->binaries != NULL))
-    {
-      g_list_free_full (env->binaries, g_free);
-      env->binaries = NULL;
-    }
+  /* Free binaries */
+  g_list_free (env->binaries_list);
+  g_array_unref (env->binaries);
+  g_ptr_array_unref (env->arenas);
 
   G_OBJECT_CLASS (verve_env_parent_class)->finalize (object);
 }
@@ -210,10 +503,399 @@ verve_env_get_path (VerveEnv *env)
 
 
 
+guint
+verve_env_get_n_binaries (VerveEnv *env)
+{
+  return env->binaries->len;
+}
+
+
+
+const gchar *
+verve_env_get_binary (VerveEnv *env,
+                      guint     index,
+                      gsize    *length)
+{
+  VerveEnvBinary *binary;
+
+  g_return_val_if_fail (index < env->binaries->len, NULL);
+
+  /* Binaries are sorted bytewise, the name is owned by the environment */
+  binary = &g_array_index (env->binaries, VerveEnvBinary, index);
+
+  if (length != NULL)
+    *length = binary->length;
+
+  return binary->name;
+}
+
+
+
 GList *
 verve_env_get_path_binaries (VerveEnv *env)
 {
-  return env->binaries;
+  guint i;
+
+  /* Build the list on demand, it references the names owned by the environment */
+  if (env->binaries_list == NULL)
+    for (i = env->binaries->len; i > 0; i--)
+      env->binaries_list = g_list_prepend (env->binaries_list,
+                                           (gpointer) g_array_index (env->binaries, VerveEnvBinary, i - 1).name);
+
+  return env->binaries_list;
+}
+
+
+
+static GArray *
+verve_env_add_binaries (VerveEnv    *env,
+                        GArray      *binaries,
+                        GPtrArray   *names,
+                        gchar     ***added)
+{
+  VerveEnvBinary *batch_binaries;
+  GPtrArray      *batch;
+  GArray         *result;
+  gchar          *p;
+  gsize           size = 0;
+  guint           i, j;
+
+  *added = NULL;
+
+  batch = g_ptr_array_new ();
+
+  /* Pick the names which are not known yet */
+  for (i = 0; i < names->len; i++)
+    {
+      gchar *name = g_ptr_array_index (names, i);
+
+      if (g_hash_table_contains (env->index, name))
+        continue;
+
+      /* Index the name right away to catch duplicates within the batch */
+      g_hash_table_add (env->index, name);
+      g_ptr_array_add (batch, name);
+      size += strlen (name) + 1;
+    }
+
+  if (batch->len == 0)
+    {
+      g_ptr_array_free (batch, TRUE);
+      return NULL;
+    }
+
+  /* Copy the new names into one contiguous block */
+  p = g_malloc (size);
+  g_ptr_array_add (env->arenas, p);
+
+  batch_binaries = g_new (VerveEnvBinary, batch->len);
+
+  for (i = 0; i < batch->len; i++)
+    {
+      const gchar *name = g_ptr_array_index (batch, i);
+
+      batch_binaries[i].name = p;
+      batch_binaries[i].length = strlen (name);
+      memcpy (p, name, batch_binaries[i].length + 1);
+      p += batch_binaries[i].length + 1;
+
+      /* Make the index refer to the stored copy instead */
+      g_hash_table_add (env->index, (gpointer) batch_binaries[i].name);
+    }
+
+  /* Sort the way the completion index is sorted, so the batch can be merged into it as it is */
+  qsort (batch_binaries, batch->len, sizeof (VerveEnvBinary), verve_env_binary_compare);
+
+  *added = g_new (gchar *, batch->len + 1);
+
+  for (i = 0; i < batch->len; i++)
+    (*added)[i] = (gchar *) batch_binaries[i].name;
+
+  (*added)[batch->len] = NULL;
+
+  /* Merge both sorted sequences into a new array, the old one may still be in use */
+  result = g_array_sized_new (FALSE, FALSE, sizeof (VerveEnvBinary), binaries->len + batch->len);
+
+  for (i = 0, j = 0; i < binaries->len || j < batch->len;)
+    {
+      if (j == batch->len
+          || (i < binaries->len
+              && verve_env_binary_compare (&g_array_index (binaries, VerveEnvBinary, i), &batch_binaries[j]) <= 0))
+        g_array_append_val (result, g_array_index (binaries, VerveEnvBinary, i++));
+      else
+        g_array_append_val (result, batch_binaries[j++]);
+    }
+
+  g_free (batch_binaries);
+  g_ptr_array_free (batch, TRUE);
+
+  return result;
+}
+
+
+
+static void
+verve_env_set_binaries (VerveEnv *env,
+                        GArray   *binaries)
+{
+  /* Replace the binaries array, readers never see it change */
+  g_array_unref (env->binaries);
+  env->binaries = g_array_ref (binaries);
+
+  /* The compatibility list is out of date now */
+  g_list_free (env->binaries_list);
+  env->binaries_list = NULL;
+}
+
+
+
+static guint
+verve_env_binary_hash (gconstpointer key)
+{
+  const gchar *p;
+  guint        hash = 5381;
+
+  /* Case-insensitive variant of the djb hash used by g_str_hash () */
+  for (p = key; *p != '\0'; p++)
+    hash = (hash << 5) + hash + (guchar) g_ascii_tolower (*p);
+
+  return hash;
+}
+
+
+
+static gboolean
+verve_env_binary_equal (gconstpointer a,
+                        gconstpointer b)
+{
+  return g_ascii_strcasecmp (a, b) == 0;
+}
+
+
+
+static gint
+verve_env_binary_compare (gconstpointer a,
+                          gconstpointer b)
+{
+  const VerveEnvBinary *binary_a = a;
+  const VerveEnvBinary *binary_b = b;
+  gint                  result;
+
+  /* Compare the names bytewise like strcmp (), a name sorts before the names it is a prefix of */
+  result = memcmp (binary_a->name, binary_b->name, MIN (binary_a->length, binary_b->length));
+  if (result != 0)
+    return result;
+
+  return (binary_a->length > binary_b->length) - (binary_a->length < binary_b->length);
+}
+
+
+
+static gchar *
+verve_env_display_name (const gchar *name)
+{
+  const gchar *p;
+
+  /* Plain ASCII names are valid UTF-8 already */
+  for (p = name; *p != '\0'; p++)
+    if (G_UNLIKELY ((guchar) *p >= 0x80))
+      return g_filename_display_name (name);
+
+  return g_strdup (name);
+}
+
+
+
+#if defined (HAVE_DIRFD) && defined (HAVE_FACCESSAT) && defined (HAVE_FSTATAT)
+static gboolean
+verve_env_is_executable_at (VerveEnv    *env,
+                            gint         fd,
+                            const gchar *name)
+{
+  struct stat st;
+  gint        i;
+
+  /* Follow symlinks, only regular files are binaries */
+  if (fstatat (fd, name, &st, 0) != 0 || !S_ISREG (st.st_mode))
+    return FALSE;
+
+  /* Decide from the mode bits instead of asking the kernel a second time.
+   * Like access () for root, any execute bit will do */
+  if (env->euid == 0)
+    return (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0;
+
+  if (st.st_uid == env->euid)
+    return (st.st_mode & S_IXUSR) != 0;
+
+  if (st.st_gid == env->egid)
+    return (st.st_mode & S_IXGRP) != 0;
+
+  for (i = 0; i < env->n_groups; i++)
+    if (st.st_gid == env->groups[i])
+      return (st.st_mode & S_IXGRP) != 0;
+
+  return (st.st_mode & S_IXOTH) != 0;
+}
+
+
+
+static GPtrArray *
+verve_env_scan_directory (VerveEnv    *env,
+                          const gchar *path,
+                          guint       *n_entries,
+                          guint       *n_syscalls)
+{
+  GPtrArray     *names;
+  struct dirent *entry;
+  gboolean       executable;
+  gint           fd;
+  /* Try opening the directory */
+  DIR *dir = opendir (path);
+
+  /* Return NULL if this directory can't be opened */
+  if (G_UNLIKELY (dir == NULL))
+    return NULL;
+
+  /* Files are checked relative to the directory, no need to build their paths */
+  fd = dirfd (dir);
+
+  names = g_ptr_array_new_with_free_func (g_free);
+
+  /* Iterate over files in this directory */
+  while (!g_cancellable_is_cancelled (env->load_cancellable) && (entry = readdir (dir)) != NULL)
+    {
+      const gchar *current = entry->d_name;
+
+      /* Skip "." and ".." */
+      if (current[0] == '.' && (current[1] == '\0' || (current[1] == '.' && current[2] == '\0')))
+        continue;
+
+      (*n_entries)++;
+
+#ifdef DT_UNKNOWN
+      switch (entry->d_type)
+        {
+        case DT_REG:
+          /* A regular file, let the kernel check the permissions. It knows about ACLs */
+          executable = (faccessat (fd, current, X_OK, 0) == 0);
+          (*n_syscalls)++;
+          break;
+
+        case DT_LNK:
+        case DT_UNKNOWN:
+          /* Follow symlinks, some file systems don't report the file type */
+          executable = verve_env_is_executable_at (env, fd, current);
+          (*n_syscalls)++;
+          break;
+
+        default:
+          /* Directories, devices, sockets and pipes */
+          executable = FALSE;
+          break;
+        }
+#else
+      executable = verve_env_is_executable_at (env, fd, current);
+      (*n_syscalls)++;
+#endif
+
+      /* Add the file to the result if it is an executable, converted to valid UTF-8 */
+      if (executable)
+        g_ptr_array_add (names, verve_env_display_name (current));
+    }
+
+  /* Close directory */
+  closedir (dir);
+
+  return names;
+}
+#else
+static GPtrArray *
+verve_env_scan_directory (VerveEnv    *env,
+                          const gchar *path,
+                          guint       *n_entries,
+                          guint       *n_syscalls)
+{
+  GPtrArray   *names;
+  const gchar *current;
+  /* Try opening the directory */
+  GDir *dir = g_dir_open (path, 0, NULL);
+
+  /* Return NULL if this directory can't be opened */
+  if (G_UNLIKELY (dir == NULL))
+    return NULL;
+
+  names = g_ptr_array_new_with_free_func (g_free);
+
+  /* Iterate over files in this directory */
+  while (!g_cancellable_is_cancelled (env->load_cancellable) && (current = g_dir_read_name (dir)) != NULL)
+    {
+      /* Determine the absolute path to the file */
+      gchar *filename = g_build_filename (path, current, NULL);
+
+      (*n_entries)++;
+      (*n_syscalls) += 2;
+
+      /* Add the file to the result if it is an executable, converted to valid UTF-8 */
+      if (g_file_test (filename, G_FILE_TEST_IS_EXECUTABLE) &&
+          !g_file_test (filename, G_FILE_TEST_IS_DIR))
+        g_ptr_array_add (names, verve_env_display_name (current));
+
+      /* Free absolute path */
+      g_free (filename);
+    }
+
+  /* Close directory */
+  g_dir_close (dir);
+
+  return names;
+}
+#endif
+
+
+
+static void
+verve_env_scan_job (gpointer data,
+                    gpointer user_data)
+{
+  VerveEnvScanJob *job = data;
+  VerveCacheDir   *dir = &job->dir;
+  gint64           start;
+
+  /* Don't touch the file system anymore once loading was cancelled */
+  if (G_UNLIKELY (g_cancellable_is_cancelled (job->env->load_cancellable)))
+    {
+      g_async_queue_push (job->done, job);
+      return;
+    }
+
+#ifdef VERVE_ENV_TESTING
+  /* Pretend to read from a stale network mount, which does not notice cancellation either */
+  if (g_atomic_int_get (&verve_env_test_stall) > 0)
+    g_usleep (g_atomic_int_get (&verve_env_test_stall) * G_TIME_SPAN_MILLISECOND);
+#endif
+
+  start = g_get_monotonic_time ();
+
+  /* Reuse the cached names if the directory did not change */
+  dir->names = verve_cache_lookup (job->cache, dir);
+
+  /* Otherwise scan the directory, names stays NULL if it can't be opened */
+  if (dir->names == NULL)
+    {
+      dir->names = verve_env_scan_directory (job->env, dir->path, &job->n_entries, &job->n_syscalls);
+      job->scanned = (dir->names != NULL);
+    }
+
+  if (job->scanned)
+    g_debug ("%s: %u entries scanned in %.3f ms, %u binaries, %.2f syscalls per entry",
+             dir->path, job->n_entries, (g_get_monotonic_time () - start) / 1000.0, dir->names->len,
+             job->n_entries > 0 ? (gdouble) job->n_syscalls / job->n_entries : 0.0);
+  else if (dir->names != NULL)
+    g_debug ("%s: %u binaries read from the cache in %.3f ms",
+             dir->path, dir->names->len, (g_get_monotonic_time () - start) / 1000.0);
+
+  /* Hand the result over to the loader thread */
+  g_async_queue_push (job->done, job);
 }
 
 
@@ -221,73 +903,368 @@ verve_env_get_path_binaries (VerveEnv *env)
 static gpointer
 verve_env_load_thread (gpointer user_data)
 {
-  VerveEnv *env = VERVE_ENV (user_data);
-  gchar   **paths;
-  guint       i;
+  VerveEnv        *env = VERVE_ENV (user_data);
+  VerveEnvScanJob *jobs;
+  VerveCache      *cache;
+  VerveCacheDir   *dirs;
+  GArray          *binaries;
+  GThreadPool     *pool;
+  GAsyncQueue     *done;
+  gchar          **paths;
+  gboolean         cache_dirty = FALSE;
+  guint            n_paths;
+  guint            n_jobs = 0;
+  guint            n_dirs = 0;
+  guint            i, j;
   
   /* Get $PATH directories */
   paths = verve_env_get_path (env);
-  
-  /* Iterate over paths list */
-  for (i = 0; !env->load_thread_cancelled && i < g_strv_length (paths); i++)
-  {
-    const gchar *current;
-    gchar       *filename;
-    GList       *lp;
-    /* Try opening the directory */
-    GDir *dir = g_dir_open (paths[i], 0, NULL);
-
-    /* Continue with next directory if this one cant' be opened */
-    if (G_UNLIKELY (dir == NULL)) 
-      continue;
-
-    /* Iterate over files in this directory */
-    while (!env->load_thread_cancelled && (current = g_dir_read_name (dir)) != NULL)
-      {
-        /* Convert to valid UTF-8 */
-        filename = g_filename_display_name (current);
+  n_paths = g_strv_length (paths);
+
+  /* Load the binaries found during previous runs */
+  cache = verve_cache_load ();
+
+  /* At most one job per $PATH entry, kept in $PATH order */
+  jobs = g_new0 (VerveEnvScanJob, n_paths);
+  done = g_async_queue_new ();
+
+  for (i = 0; !g_cancellable_is_cancelled (env->load_cancellable) && i < n_paths; i++)
+    {
+      VerveEnvScanJob *job = &jobs[n_jobs];
+      struct stat      st;
+
+      /* Skip entries which are not directories */
+      if (stat (paths[i], &st) != 0 || !S_ISDIR (st.st_mode))
+        continue;
+
+      /* Skip directories which appeared under another name already (e.g. /bin -> /usr/bin) */
+      for (j = 0; j < n_jobs; j++)
+        if (jobs[j].dir.dev == (guint64) st.st_dev && jobs[j].dir.ino == (guint64) st.st_ino)
+          break;
+
+      if (j < n_jobs)
+        {
+          g_debug ("%s: same directory as %s, skipped", paths[i], jobs[j].dir.path);
+          continue;
+        }
+
+      job->env = env;
+      job->cache = cache;
+      job->done = done;
+      job->dir.path = paths[i];
+      job->dir.dev = st.st_dev;
+      job->dir.ino = st.st_ino;
+      job->dir.mtime = st.st_mtim.tv_sec;
+      job->dir.mtime_nsec = st.st_mtim.tv_nsec;
+
+      n_jobs++;
+    }
+
+  /* Scan the directories in parallel, slow (e.g. network) mounts don't hold up the others */
+  pool = g_thread_pool_new (verve_env_scan_job, NULL,
+                            CLAMP (n_jobs, 1, VERVE_ENV_MAX_SCAN_THREADS),
+                            TRUE, NULL);
+
+  for (i = 0; i < n_jobs; i++)
+    {
+      /* Fall back to scanning in this thread if the pool could not be created */
+      if (G_UNLIKELY (pool == NULL))
+        verve_env_scan_job (&jobs[i], NULL);
+      else
+        g_thread_pool_push (pool, &jobs[i], NULL);
+    }
+
+  /* The binaries found so far, owned by this thread until they are delivered */
+  binaries = g_array_new (FALSE, FALSE, sizeof (VerveEnvBinary));
+
+  /* Publish the binaries of each directory as soon as it has been read */
+  for (i = 0; i < n_jobs; i++)
+    {
+      VerveEnvScanJob *job = g_async_queue_pop (done);
+      GArray          *merged;
+      gchar          **added;
+
+      if (G_UNLIKELY (g_cancellable_is_cancelled (env->load_cancellable) || job->dir.names == NULL))
+        continue;
+
+      /* Add the names which are not provided by another directory already */
+      merged = verve_env_add_binaries (env, binaries, job->dir.names, &added);
+
+      if (merged == NULL)
+        continue;
+
+      /* Hand the merged array to the main loop, it is not modified anymore */
+      g_array_unref (binaries);
+      binaries = merged;
+      verve_env_deliver (env, binaries, added);
+    }
+
+  g_array_unref (binaries);
 
-        /* Avoid duplicates */
-        for (lp = g_list_first (env->binaries); lp != NULL; lp = lp->next)
-          if (g_ascii_strcasecmp (lp->data, filename) == 0)
-            break;
-       
-        /* Check details of file if it's not in the list already */
-        if (G_LIKELY (lp == NULL))
-          {
-            /* Determine the absolute path to the file */
-            gchar *path = g_build_filename (paths[i], current, NULL);
+  /* All jobs are finished, release the threads */
+  if (G_LIKELY (pool != NULL))
+    g_thread_pool_free (pool, FALSE, TRUE);
 
-            /* Check if the path refers to an executable */
-            if (g_file_test (path, G_FILE_TEST_IS_EXECUTABLE) &&
-                !g_file_test (path, G_FILE_TEST_IS_DIR))
-              {
-                /* Add file filename to the list */
-                env->binaries = g_list_prepend (env->binaries, filename);
+  g_async_queue_unref (done);
 
-                /* No need to free the filename later in this function */
-                filename = NULL;
-              }
+  /* Collect the directories which could be read, preserving their order */
+  dirs = g_new0 (VerveCacheDir, n_jobs);
 
-            /* Free absolute path */
-            g_free (path);
-          }
+  for (i = 0; i < n_jobs; i++)
+    {
+      if (jobs[i].dir.names == NULL)
+        continue;
+
+      dirs[n_dirs++] = jobs[i].dir;
+      cache_dirty |= jobs[i].scanned;
+
+      /* Sum up the work done for the directories */
+      env->n_scanned_entries += jobs[i].n_entries;
+      env->n_scan_syscalls += jobs[i].n_syscalls;
+
+      /* Remember the directory for monitoring */
+      g_ptr_array_add (env->directories, (gpointer) jobs[i].dir.path);
+    }
+
+  g_free (jobs);
 
-        /* Release filename if necessary */
-        g_free (filename);
-      }
+  /* Update the cache if directories were rescanned, added or removed */
+  if (!g_cancellable_is_cancelled (env->load_cancellable) && (cache_dirty || verve_cache_get_n_dirs (cache) != n_dirs))
+    verve_cache_write (dirs, n_dirs);
 
-    /* Close directory */
-    g_dir_close (dir);
-  }
+  verve_cache_free (cache);
 
-  /* Sort binaries */
-  env->binaries = g_list_sort (env->binaries, (GCompareFunc) g_utf8_collate);
+  /* Free the per-directory names */
+  for (i = 0; i < n_dirs; i++)
+    g_ptr_array_unref (dirs[i].names);
 
-  /* Emit 'load-binaries' signal */
-  g_signal_emit_by_name (env, "load-binaries");
+  g_free (dirs);
 
-  return env->binaries;
+  /* Let the main loop know that all binaries are known now. The environment
+   * is not touched by this thread anymore afterwards */
+  verve_env_deliver (env, NULL, NULL);
+
+  /* Tell verve_env_stop_loading () that the thread can be joined now */
+  g_mutex_lock (&env->load_mutex);
+  env->load_finished = TRUE;
+  g_cond_broadcast (&env->load_cond);
+  g_mutex_unlock (&env->load_mutex);
+
+  /* Release the environment, this finalizes it if the thread was detached */
+  g_object_unref (env);
+
+  return NULL;
+}
+
+
+
+/*********************************************************************
+ *
+ * Delivery of loader results to the main loop
+ *
+ *********************************************************************/
+
+static void
+verve_env_deliver (VerveEnv  *env,
+                   GArray    *binaries,
+                   gchar    **added)
+{
+  VerveEnvDelivery *delivery = g_new (VerveEnvDelivery, 1);
+
+  delivery->binaries = binaries != NULL ? g_array_ref (binaries) : NULL;
+  delivery->added = added;
+
+  /* Queue the result and wake up the main loop */
+  g_async_queue_push (env->deliveries, delivery);
+  g_source_set_ready_time (env->delivery_source, 0);
+}
+
+
+
+static gboolean
+verve_env_delivery_dispatch (GSource    *source,
+                             GSourceFunc callback,
+                             gpointer    user_data)
+{
+  return callback (user_data);
+}
+
+
+
+static gboolean
+verve_env_process_deliveries (gpointer user_data)
+{
+  VerveEnv         *env = VERVE_ENV (user_data);
+  VerveEnvDelivery *delivery;
+  gint64            start = g_get_monotonic_time ();
+
+  /* Go to sleep before looking at the queue, so no wake up gets lost */
+  g_source_set_ready_time (env->delivery_source, -1);
+
+  while ((delivery = g_async_queue_try_pop (env->deliveries)) != NULL)
+    {
+      if (delivery->binaries != NULL)
+        {
+          /* Publish the new binaries */
+          verve_env_set_binaries (env, delivery->binaries);
+          g_signal_emit_by_name (env, "binaries-changed", delivery->added, NULL);
+        }
+      else
+        {
+          /* Emit 'load-binaries' signal, all binaries are known now */
+          g_signal_emit_by_name (env, "load-binaries");
+
+          /* Watch the $PATH directories for changes */
+          verve_env_start_monitors (env);
+        }
+
+      verve_env_delivery_free (delivery);
+
+      /* Leave the rest for the next iteration to keep the user interface responsive */
+      if (g_get_monotonic_time () - start >= VERVE_ENV_DELIVERY_BUDGET)
+        {
+          g_source_set_ready_time (env->delivery_source, 0);
+          break;
+        }
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+
+static void
+verve_env_delivery_free (gpointer data)
+{
+  VerveEnvDelivery *delivery = data;
+
+  if (delivery->binaries != NULL)
+    g_array_unref (delivery->binaries);
+
+  /* The names themselves are owned by the environment */
+  g_free (delivery->added);
+  g_free (delivery);
+}
+
+
+
+/*********************************************************************
+ *
+ * $PATH directory monitoring
+ *
+ *********************************************************************/
+
+static void
+verve_env_start_monitors (VerveEnv *env)
+{
+  guint i;
+
+  for (i = 0; i < env->directories->len; i++)
+    {
+      GFile        *directory = g_file_new_for_path (g_ptr_array_index (env->directories, i));
+      GFileMonitor *monitor;
+
+      /* Watch this directory, skip it if that is not possible */
+      monitor = g_file_monitor_directory (directory, G_FILE_MONITOR_NONE, NULL, NULL);
+      g_object_unref (directory);
+
+      if (G_UNLIKELY (monitor == NULL))
+        continue;
+
+      g_signal_connect (monitor, "changed", G_CALLBACK (verve_env_monitor_changed), env);
+      g_ptr_array_add (env->monitors, monitor);
+    }
+}
+
+
+
+static gboolean
+verve_env_is_binary (VerveEnv    *env,
+                     const gchar *basename)
+{
+  gboolean result = FALSE;
+  guint    i;
+
+  /* Check whether any $PATH directory provides this executable */
+  for (i = 0; !result && i < env->directories->len; i++)
+    {
+      gchar *path = g_build_filename (g_ptr_array_index (env->directories, i), basename, NULL);
+
+      result = g_file_test (path, G_FILE_TEST_IS_EXECUTABLE) && !g_file_test (path, G_FILE_TEST_IS_DIR);
+
+      g_free (path);
+    }
+
+  return result;
+}
+
+
+
+static void
+verve_env_monitor_changed (GFileMonitor      *monitor,
+                           GFile             *file,
+                           GFile             *other_file,
+                           GFileMonitorEvent  event_type,
+                           VerveEnv          *env)
+{
+  gchar    *basename;
+  gchar    *name;
+  GArray   *binaries = NULL;
+  gchar   **added = NULL;
+  gchar    *removed[2] = { NULL, NULL };
+  gpointer  key;
+  gboolean  known;
+  gboolean  exists;
+
+  /* Only creation, deletion and permission changes are of interest */
+  if (event_type != G_FILE_MONITOR_EVENT_CREATED
+      && event_type != G_FILE_MONITOR_EVENT_DELETED
+      && event_type != G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+    return;
+
+  basename = g_file_get_basename (file);
+  name = g_filename_display_name (basename);
+
+  /* Compare the index with the current state of the file system */
+  known = g_hash_table_lookup_extended (env->index, name, &key, NULL);
+  exists = verve_env_is_binary (env, basename);
+
+  if (exists && !known)
+    {
+      GPtrArray *names = g_ptr_array_new ();
+
+      /* Insert the new binary, the environment stores a copy of the name */
+      g_ptr_array_add (names, name);
+      binaries = verve_env_add_binaries (env, env->binaries, names, &added);
+      g_ptr_array_free (names, TRUE);
+    }
+  else if (!exists && known)
+    {
+      guint i;
+
+      /* Drop the binary. Its name stays allocated, so listeners may still use it */
+      g_hash_table_remove (env->index, key);
+      removed[0] = key;
+
+      /* Copy the other binaries into a new array */
+      binaries = g_array_sized_new (FALSE, FALSE, sizeof (VerveEnvBinary), env->binaries->len);
+      for (i = 0; i < env->binaries->len; i++)
+        if (g_array_index (env->binaries, VerveEnvBinary, i).name != key)
+          g_array_append_val (binaries, g_array_index (env->binaries, VerveEnvBinary, i));
+    }
+
+  /* Publish the new binaries and notify listeners about the delta */
+  if (binaries != NULL)
+    {
+      verve_env_set_binaries (env, binaries);
+      g_array_unref (binaries);
+
+      g_signal_emit_by_name (env, "binaries-changed", added, removed);
+    }
+
+  g_free (added);
+  g_free (name);
+  g_free (basename);
 }
 
 
@@ -300,4 +1277,56 @@ verve_env_load_binaries (VerveEnv *env)
 
 
 
+#ifdef VERVE_ENV_TESTING
+/*********************************************************************
+ *
+ * Hooks for tests and benchmarks
+ *
+ *********************************************************************/
+
+gchar**
+verve_env_test_add_names (VerveEnv  *env,
+                          GPtrArray *names)
+{
+  GArray  *binaries;
+  gchar  **added;
+
+  /* Take the path of a batch delivered by the loading thread. Only call
+   * this once loading is finished, the index is not locked */
+  binaries = verve_env_add_binaries (env, env->binaries, names, &added);
+
+  if (binaries != NULL)
+    {
+      verve_env_set_binaries (env, binaries);
+      g_array_unref (binaries);
+    }
+
+  return added;
+}
+
+
+
+void
+verve_env_test_set_stall (guint stall)
+{
+  /* Applies to the scanners of environments created afterwards */
+  g_atomic_int_set (&verve_env_test_stall, stall);
+}
+
+
+
+void
+verve_env_test_get_scan_counts (VerveEnv *env,
+                                guint    *n_entries,
+                                guint    *n_syscalls)
+{
+  /* Written by the loading thread before it delivers its last result */
+  *n_entries = env->n_scanned_entries;
+  *n_syscalls = env->n_scan_syscalls;
+}
+
+
+
+#endif
+
 /* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -38,12 +38,18 @@ typedef struct _VerveEnv      VerveEnv;
 #define VERVE_IS_ENV_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), VERVE_TYPE_ENV))
 #define VERVE_ENV_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), VERVE_TYPE_ENV, VerveEnvClass))
 
-GType        verve_env_get_type          (void) G_GNUC_CONST;
-VerveEnv    *verve_env_get               (void);
-gchar      **verve_env_get_path          (VerveEnv *env);
-GList       *verve_env_get_path_binaries (VerveEnv *env);
-
-void         verve_env_shutdown          (void);
+GType        verve_env_get_type             (void) G_GNUC_CONST;
+VerveEnv    *verve_env_get                  (void);
+gchar      **verve_env_get_path             (VerveEnv *env);
+guint        verve_env_get_n_binaries       (VerveEnv *env);
+const gchar *verve_env_get_binary           (VerveEnv *env,
+                                             guint     index,
+                                             gsize    *length);
+GList       *verve_env_get_path_binaries    (VerveEnv *env);
+void         verve_env_set_shutdown_timeout (VerveEnv *env,
+                                             guint     timeout);
+
+void         verve_env_shutdown             (void);
 
 G_END_DECLS;
 
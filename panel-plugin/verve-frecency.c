@@ -0,0 +1,483 @@
+/***************************************************************************
+ *            verve-frecency.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+#include <glib/gstdio.h>
+#include <libxfce4util/libxfce4util.h>
+
+#include "verve-frecency.h"
+
+
+
+/*********************************************************************
+ *
+ * Frecency store
+ * --------------
+ *
+ * Every launch of a command adds 1 to its score, and scores halve
+ * every VERVE_FRECENCY_HALF_LIFE seconds. Instead of the score itself
+ * the store keeps its rank
+ *
+ *   rank = time / VERVE_FRECENCY_HALF_LIFE + log2 (score at time)
+ *
+ * which does not change as time passes, so ranks of different commands
+ * can be compared without decaying them first.
+ *
+ * The store is an open addressing hash table of (hash of the command,
+ * rank) slots which is mapped into memory. Loading it takes no parsing
+ * and a launch only writes a single slot. All integers are stored in
+ * host byte order.
+ *
+ * Several panels may share the file. Launches and growing the table
+ * happen under an advisory lock on a separate lock file, since growing
+ * replaces the table file. After taking the lock, a panel maps the
+ * table again if another one replaced it in the meantime.
+ *
+ *   header:  "VRVF" | version (u32) | number of slots (u32) | used slots (u32)
+ *   slot:    hash (u64, 0 = empty) | rank (double)
+ *
+ *********************************************************************/
+
+#define VERVE_FRECENCY_MAGIC     "VRVF"
+#define VERVE_FRECENCY_VERSION   1
+#define VERVE_FRECENCY_MIN_SLOTS 1024
+
+/* Time after which the score of a launch has halved, in seconds */
+#define VERVE_FRECENCY_HALF_LIFE (3 * 24 * 60 * 60)
+
+/* Scores below this are dropped when the table is grown */
+#define VERVE_FRECENCY_MIN_SCORE (1.0 / 64)
+
+
+
+typedef struct
+{
+  gchar   magic[4];
+  guint32 version;
+  guint32 n_slots;
+  guint32 n_used;
+} VerveFrecencyHeader;
+
+
+
+typedef struct
+{
+  guint64 hash;
+  gdouble rank;
+} VerveFrecencySlot;
+
+
+
+/* The mapped store, NULL if it could not be opened */
+static VerveFrecencyHeader *store = NULL;
+static gsize                store_size = 0;
+static gchar               *store_filename = NULL;
+
+/* File the store is mapped from, to notice when it was replaced */
+static dev_t                store_dev = 0;
+static ino_t                store_ino = 0;
+
+/* Lock file serializing writers in all panels, -1 if unavailable */
+static gint                 lock_fd = -1;
+
+/* Number of verve_frecency_init () calls not matched by a shutdown yet */
+static guint                store_users = 0;
+
+
+
+static gdouble
+verve_frecency_now (void)
+{
+  return (gdouble) g_get_real_time () / G_USEC_PER_SEC / VERVE_FRECENCY_HALF_LIFE;
+}
+
+
+
+static guint64
+verve_frecency_hash (const gchar *command)
+{
+  const guchar *p;
+  guint64       hash = G_GUINT64_CONSTANT (14695981039346656037);
+
+  /* 64 bit FNV-1a, 0 marks empty slots */
+  for (p = (const guchar *) command; *p != '\0'; p++)
+    hash = (hash ^ *p) * G_GUINT64_CONSTANT (1099511628211);
+
+  return hash != 0 ? hash : 1;
+}
+
+
+
+static VerveFrecencySlot *
+verve_frecency_lookup (VerveFrecencyHeader *header,
+                       guint64              hash)
+{
+  VerveFrecencySlot *slots = (VerveFrecencySlot *) (header + 1);
+  guint32            mask = header->n_slots - 1;
+  guint32            i;
+  guint32            n;
+
+  /* Linear probing, giving up if growing the table failed and it is full */
+  for (i = hash & mask, n = 0; n < header->n_slots; i = (i + 1) & mask, n++)
+    if (slots[i].hash == 0 || slots[i].hash == hash)
+      return &slots[i];
+
+  return NULL;
+}
+
+
+
+static VerveFrecencyHeader *
+verve_frecency_map (const gchar *filename,
+                    guint32      n_slots,
+                    gsize       *size,
+                    struct stat *file)
+{
+  VerveFrecencyHeader *header;
+  struct stat          st;
+  gpointer             data;
+  gint                 fd;
+
+  fd = g_open (filename, O_RDWR | O_CREAT, 0600);
+  if (G_UNLIKELY (fd < 0))
+    return NULL;
+
+  /* Create an empty table if the file is new, n_slots == 0 means "existing file only" */
+  if (fstat (fd, &st) != 0
+      || (st.st_size == 0 && (n_slots == 0
+                              || ftruncate (fd, sizeof (VerveFrecencyHeader) + n_slots * sizeof (VerveFrecencySlot)) != 0
+                              || fstat (fd, &st) != 0))
+      || st.st_size < (off_t) sizeof (VerveFrecencyHeader))
+    {
+      close (fd);
+      return NULL;
+    }
+
+  data = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (G_UNLIKELY (data == MAP_FAILED))
+    return NULL;
+
+  header = data;
+
+  /* Fill in the header of a new table */
+  if (header->version == 0 && header->n_slots == 0)
+    {
+      memcpy (header->magic, VERVE_FRECENCY_MAGIC, 4);
+      header->version = VERVE_FRECENCY_VERSION;
+      header->n_slots = n_slots;
+      header->n_used = 0;
+    }
+
+  /* Reject foreign or damaged files */
+  if (memcmp (header->magic, VERVE_FRECENCY_MAGIC, 4) != 0
+      || header->version != VERVE_FRECENCY_VERSION
+      || header->n_slots == 0
+      || (header->n_slots & (header->n_slots - 1)) != 0
+      || sizeof (VerveFrecencyHeader) + (gsize) header->n_slots * sizeof (VerveFrecencySlot) != (gsize) st.st_size)
+    {
+      munmap (data, st.st_size);
+      return NULL;
+    }
+
+  *size = st.st_size;
+  *file = st;
+
+  return header;
+}
+
+
+
+static void
+verve_frecency_lock (void)
+{
+  /* Without a lock file writers are not serialized, which only risks
+   * losing a launch when several panels write at the same time */
+  if (G_LIKELY (lock_fd >= 0))
+    while (flock (lock_fd, LOCK_EX) != 0 && errno == EINTR)
+      ;
+}
+
+
+
+static void
+verve_frecency_unlock (void)
+{
+  if (G_LIKELY (lock_fd >= 0))
+    flock (lock_fd, LOCK_UN);
+}
+
+
+
+static void
+verve_frecency_set_store (VerveFrecencyHeader *header,
+                          gsize                size,
+                          const struct stat   *file)
+{
+  /* Replace the mapped table */
+  if (store != NULL)
+    munmap (store, store_size);
+
+  store = header;
+  store_size = size;
+  store_dev = file->st_dev;
+  store_ino = file->st_ino;
+}
+
+
+
+static void
+verve_frecency_refresh (void)
+{
+  VerveFrecencyHeader *header;
+  struct stat          st;
+  gsize                size;
+
+  /* Map the table again if another panel grew it, holding the lock */
+  if (g_stat (store_filename, &st) != 0 || (st.st_dev == store_dev && st.st_ino == store_ino))
+    return;
+
+  header = verve_frecency_map (store_filename, 0, &size, &st);
+  if (G_LIKELY (header != NULL))
+    verve_frecency_set_store (header, size, &st);
+}
+
+
+
+void
+verve_frecency_init (void)
+{
+  VerveFrecencyHeader *header;
+  struct stat          st;
+  gchar               *lock_filename;
+  gchar               *dirname;
+  gsize                size;
+
+  /* The store is shared by all plugin instances */
+  if (store_users++ > 0)
+    return;
+
+  store_filename = xfce_resource_save_location (XFCE_RESOURCE_DATA, "xfce4/Verve/frecency", TRUE);
+  if (G_UNLIKELY (store_filename == NULL))
+    return;
+
+  lock_filename = g_strconcat (store_filename, ".lock", NULL);
+  lock_fd = g_open (lock_filename, O_RDWR | O_CREAT, 0600);
+  g_free (lock_filename);
+
+  /* Another panel may be creating or growing the table */
+  verve_frecency_lock ();
+
+  header = verve_frecency_map (store_filename, VERVE_FRECENCY_MIN_SLOTS, &size, &st);
+
+  /* Start over if the file is unusable */
+  if (G_UNLIKELY (header == NULL))
+    {
+      dirname = g_path_get_dirname (store_filename);
+      if (g_file_test (dirname, G_FILE_TEST_IS_DIR) && g_unlink (store_filename) == 0)
+        header = verve_frecency_map (store_filename, VERVE_FRECENCY_MIN_SLOTS, &size, &st);
+      g_free (dirname);
+    }
+
+  if (G_LIKELY (header != NULL))
+    verve_frecency_set_store (header, size, &st);
+
+  verve_frecency_unlock ();
+}
+
+
+
+void
+verve_frecency_shutdown (void)
+{
+  if (store_users == 0 || --store_users > 0)
+    return;
+
+  if (store != NULL)
+    munmap (store, store_size);
+
+  store = NULL;
+  g_free (store_filename);
+  store_filename = NULL;
+
+  if (lock_fd >= 0)
+    close (lock_fd);
+
+  lock_fd = -1;
+}
+
+
+
+static void
+verve_frecency_grow (void)
+{
+  VerveFrecencyHeader *header;
+  VerveFrecencySlot   *slots = (VerveFrecencySlot *) (store + 1);
+  VerveFrecencySlot   *slot;
+  struct stat          st;
+  gdouble              min_rank;
+  gchar               *tmp_filename;
+  gsize                size;
+  guint32              n_slots;
+  guint32              n_live = 0;
+  guint32              i;
+
+  /* Forget commands whose score has decayed to almost nothing */
+  min_rank = verve_frecency_now () + log2 (VERVE_FRECENCY_MIN_SCORE);
+
+  for (i = 0; i < store->n_slots; i++)
+    if (slots[i].hash != 0 && slots[i].rank >= min_rank)
+      n_live++;
+
+  /* Keep the table at most half full */
+  for (n_slots = VERVE_FRECENCY_MIN_SLOTS; n_slots < 2 * (n_live + 1); n_slots *= 2)
+    ;
+
+  /* Build the new table next to the old one and move it into place */
+  tmp_filename = g_strconcat (store_filename, ".new", NULL);
+  g_unlink (tmp_filename);
+  header = verve_frecency_map (tmp_filename, n_slots, &size, &st);
+
+  if (G_LIKELY (header != NULL))
+    {
+      for (i = 0; i < store->n_slots; i++)
+        if (slots[i].hash != 0 && slots[i].rank >= min_rank)
+          {
+            slot = verve_frecency_lookup (header, slots[i].hash);
+            if (G_LIKELY (slot != NULL && slot->hash == 0))
+              {
+                *slot = slots[i];
+                header->n_used++;
+              }
+          }
+
+      if (g_rename (tmp_filename, store_filename) == 0)
+        verve_frecency_set_store (header, size, &st);
+      else
+        {
+          munmap (header, size);
+          g_unlink (tmp_filename);
+        }
+    }
+
+  g_free (tmp_filename);
+}
+
+
+
+static void
+verve_frecency_bump (const gchar *command,
+                     gdouble      now)
+{
+  VerveFrecencySlot *slot;
+  guint64            hash = verve_frecency_hash (command);
+
+  /* Make room before the table gets crowded */
+  if (4 * (store->n_used + 1) > 3 * store->n_slots)
+    verve_frecency_grow ();
+
+  slot = verve_frecency_lookup (store, hash);
+
+  if (G_UNLIKELY (slot == NULL))
+    return;
+
+  if (slot->hash == 0)
+    {
+      /* Growing failed, don't fill up the table any further */
+      if (4 * (store->n_used + 1) > 3 * store->n_slots)
+        return;
+
+
+      /* First launch */
+      slot->rank = now;
+      slot->hash = hash;
+      store->n_used++;
+    }
+  else
+    {
+      /* Decay the old score to now and add this launch */
+      slot->rank = now + log2 (exp2 (slot->rank - now) + 1.0);
+    }
+}
+
+
+
+void
+verve_frecency_add (const gchar *command)
+{
+  const gchar *end;
+  gchar       *program;
+  gdouble      now = verve_frecency_now ();
+
+  if (G_UNLIKELY (store == NULL))
+    return;
+
+  command += strspn (command, " \t");
+  if (*command == '\0')
+    return;
+
+  /* Serialize with the other panels and pick up a table they grew */
+  verve_frecency_lock ();
+  verve_frecency_refresh ();
+
+  verve_frecency_bump (command, now);
+
+  /* Launching "firefox http://xfce.org" counts for "firefox", too */
+  end = command + strcspn (command, " \t");
+  if (*end != '\0')
+    {
+      program = g_strndup (command, end - command);
+      verve_frecency_bump (program, now);
+      g_free (program);
+    }
+
+  verve_frecency_unlock ();
+}
+
+
+
+gdouble
+verve_frecency_get (const gchar *command)
+{
+  VerveFrecencySlot *slot;
+
+  if (G_UNLIKELY (store == NULL))
+    return VERVE_FRECENCY_NONE;
+
+  slot = verve_frecency_lookup (store, verve_frecency_hash (command));
+
+  return slot != NULL && slot->hash != 0 ? slot->rank : VERVE_FRECENCY_NONE;
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
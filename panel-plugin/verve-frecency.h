@@ -0,0 +1,43 @@
+/***************************************************************************
+ *            verve-frecency.h
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __VERVE_FRECENCY_H__
+#define __VERVE_FRECENCY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS;
+
+/* Rank of commands which were never launched */
+#define VERVE_FRECENCY_NONE (-G_MAXDOUBLE)
+
+void    verve_frecency_init     (void);
+void    verve_frecency_shutdown (void);
+
+void    verve_frecency_add      (const gchar *command);
+gdouble verve_frecency_get      (const gchar *command);
+
+G_END_DECLS;
+
+#endif /* !__VERVE_FRECENCY_H__ */
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,571 @@
+/***************************************************************************
+ *            verve-fuzzy.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define VERVE_FUZZY_HAVE_AVX2 1
+#endif
+
+#include "verve-fuzzy.h"
+
+
+
+/*********************************************************************
+ *
+ * Fuzzy matching
+ * --------------
+ *
+ * A pattern matches a string if its characters occur in the string in
+ * the same order, ignoring ASCII case (e.g. "xfset" matches
+ * "xfce4-settings-manager"). Candidates are first checked against a
+ * bitmask of the character classes they contain, which rejects most
+ * of them without looking at the string. The survivors are scored like
+ * fzf does: matches at word boundaries and runs of consecutive
+ * characters are rewarded, gaps are penalized.
+ *
+ * Strings of up to 64 bytes, i.e. nearly all command names, are matched
+ * bit-parallel. A few SSE2 compares per 16 bytes give a bit mask of the
+ * positions of each pattern character and of each character class, the
+ * match positions, gaps and bonuses then follow from bit operations on
+ * those masks without looking at single bytes. Longer strings are
+ * searched with a vectorized character scan and scored byte by byte.
+ *
+ *********************************************************************/
+
+#define VERVE_FUZZY_SCORE_MATCH        16
+#define VERVE_FUZZY_BONUS_BOUNDARY     8
+#define VERVE_FUZZY_BONUS_CAMEL_CASE   7
+#define VERVE_FUZZY_BONUS_CONSECUTIVE  4
+#define VERVE_FUZZY_PENALTY_GAP_START  3
+#define VERVE_FUZZY_PENALTY_GAP_EXTEND 1
+
+/* Longest string matched bit-parallel, one bit per byte */
+#define VERVE_FUZZY_BITS               64
+
+
+
+typedef gssize (*VerveFuzzyFindFunc) (const gchar *str,
+                                      gsize        len,
+                                      gsize        from,
+                                      gchar        c);
+
+
+
+static guint
+verve_fuzzy_char_class (guchar c)
+{
+  /* Letters (case-folded) and digits get a bit each */
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= '0' && c <= '9')
+    return 26 + c - '0';
+
+  switch (c)
+    {
+    case '-': return 36;
+    case '_': return 37;
+    case '.': return 38;
+    case ' ': return 39;
+    default:  return c < 0x80 ? 40 : 41 + (c & 0x0f);
+    }
+}
+
+
+
+void
+verve_fuzzy_key_init (VerveFuzzyKey *key,
+                      const gchar   *str)
+{
+  const gchar *p;
+
+  key->mask = 0;
+
+  for (p = str; *p != '\0'; p++)
+    key->mask |= G_GUINT64_CONSTANT (1) << verve_fuzzy_char_class (*p);
+
+  key->length = p - str;
+}
+
+
+
+gboolean
+verve_fuzzy_may_match (const VerveFuzzyKey *pattern,
+                       const VerveFuzzyKey *key)
+{
+  /* Every character class of the pattern has to occur in the string */
+  return (pattern->mask & ~key->mask) == 0 && pattern->length <= key->length;
+}
+
+
+
+static gssize
+verve_fuzzy_find_scalar (const gchar *str,
+                         gsize        len,
+                         gsize        from,
+                         gchar        c)
+{
+  gchar  upper = g_ascii_toupper (c);
+  gsize  i;
+
+  for (i = from; i < len; i++)
+    if (str[i] == c || str[i] == upper)
+      return i;
+
+  return -1;
+}
+
+
+
+#if defined (__SSE2__)
+static gssize
+verve_fuzzy_find_sse2 (const gchar *str,
+                       gsize        len,
+                       gsize        from,
+                       gchar        c)
+{
+  __m128i lower = _mm_set1_epi8 (c);
+  __m128i upper = _mm_set1_epi8 (g_ascii_toupper (c));
+  gsize   i;
+
+  /* Compare 16 bytes at a time, never reading past the string */
+  for (i = from; i + 16 <= len; i += 16)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) (str + i));
+      gint    bits = _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (chunk, lower),
+                                                      _mm_cmpeq_epi8 (chunk, upper)));
+
+      if (bits != 0)
+        return i + __builtin_ctz (bits);
+    }
+
+  return verve_fuzzy_find_scalar (str, len, i, c);
+}
+#endif
+
+
+
+#if defined (VERVE_FUZZY_HAVE_AVX2)
+__attribute__ ((target ("avx2"))) static gssize
+verve_fuzzy_find_avx2 (const gchar *str,
+                       gsize        len,
+                       gsize        from,
+                       gchar        c)
+{
+  __m256i lower = _mm256_set1_epi8 (c);
+  __m256i upper = _mm256_set1_epi8 (g_ascii_toupper (c));
+  gsize   i;
+
+  /* Compare 32 bytes at a time, never reading past the string */
+  for (i = from; i + 32 <= len; i += 32)
+    {
+      __m256i chunk = _mm256_loadu_si256 ((const __m256i *) (str + i));
+      guint   bits = _mm256_movemask_epi8 (_mm256_or_si256 (_mm256_cmpeq_epi8 (chunk, lower),
+                                                            _mm256_cmpeq_epi8 (chunk, upper)));
+
+      if (bits != 0)
+        return i + __builtin_ctz (bits);
+    }
+
+  return verve_fuzzy_find_scalar (str, len, i, c);
+}
+#endif
+
+
+
+static VerveFuzzyFindFunc
+verve_fuzzy_get_find_func (void)
+{
+  static VerveFuzzyFindFunc find = NULL;
+
+  /* Pick the widest kernel supported by this CPU once */
+  if (G_UNLIKELY (find == NULL))
+    {
+      find = verve_fuzzy_find_scalar;
+#if defined (__SSE2__)
+      find = verve_fuzzy_find_sse2;
+#endif
+#if defined (VERVE_FUZZY_HAVE_AVX2)
+      if (__builtin_cpu_supports ("avx2"))
+        find = verve_fuzzy_find_avx2;
+#endif
+    }
+
+  return find;
+}
+
+
+
+static gint
+verve_fuzzy_bonus (const gchar *str,
+                   gsize        pos)
+{
+  guchar prev;
+  guchar c = str[pos];
+
+  /* Start of the string */
+  if (pos == 0)
+    return VERVE_FUZZY_BONUS_BOUNDARY;
+
+  prev = str[pos - 1];
+
+  /* Start of a word (e.g. "settings" in "xfce4-settings-manager") */
+  if (g_ascii_isalnum (c) && !g_ascii_isalnum (prev))
+    return VERVE_FUZZY_BONUS_BOUNDARY;
+
+  /* camelCase and letters following digits */
+  if ((g_ascii_isupper (c) && g_ascii_islower (prev))
+      || (g_ascii_isalpha (c) && g_ascii_isdigit (prev)))
+    return VERVE_FUZZY_BONUS_CAMEL_CASE;
+
+  return 0;
+}
+
+
+
+static gint
+verve_fuzzy_score_bytes (const gchar *pattern,
+                         gsize        pattern_len,
+                         const gchar *str,
+                         gsize        len)
+{
+  VerveFuzzyFindFunc find = verve_fuzzy_get_find_func ();
+  gboolean           in_gap = FALSE;
+  gssize             pos = 0;
+  gsize              start;
+  gsize              end;
+  gsize              i, j;
+  gint               score = 0;
+
+  /* Find the end of the first occurrence of the pattern */
+  for (i = 0; i < pattern_len; i++)
+    {
+      pos = find (str, len, pos, g_ascii_tolower (pattern[i]));
+
+      if (pos < 0)
+        return VERVE_FUZZY_NO_MATCH;
+
+      pos++;
+    }
+
+  end = pos;
+
+  /* Walk back to the shortest window ending there */
+  for (start = end, j = pattern_len; j > 0; )
+    if (g_ascii_tolower (str[--start]) == g_ascii_tolower (pattern[j - 1]))
+      j--;
+
+  /* Score the matches inside the window */
+  for (i = start, j = 0; i < end; i++)
+    {
+      if (g_ascii_tolower (str[i]) == g_ascii_tolower (pattern[j]))
+        {
+          gint bonus = verve_fuzzy_bonus (str, i);
+
+          /* Continuing a run of matches is worth something, too */
+          if (j > 0 && !in_gap)
+            bonus = MAX (bonus, VERVE_FUZZY_BONUS_CONSECUTIVE);
+
+          /* The first character counts twice */
+          if (j == 0)
+            bonus *= 2;
+
+          score += VERVE_FUZZY_SCORE_MATCH + bonus;
+          in_gap = FALSE;
+
+          if (++j == pattern_len)
+            break;
+        }
+      else
+        {
+          score -= in_gap ? VERVE_FUZZY_PENALTY_GAP_EXTEND : VERVE_FUZZY_PENALTY_GAP_START;
+          in_gap = TRUE;
+        }
+    }
+
+  return score;
+}
+
+
+
+#if defined (__SSE2__)
+static inline guint64
+verve_fuzzy_bits_from (guint pos)
+{
+  /* Bits of the positions pos ... 63 */
+  return pos < VERVE_FUZZY_BITS ? G_MAXUINT64 << pos : 0;
+}
+
+
+
+static inline guint64
+verve_fuzzy_bits_below (guint pos)
+{
+  /* Bits of the positions 0 ... pos - 1 */
+  return pos < VERVE_FUZZY_BITS ? (G_GUINT64_CONSTANT (1) << pos) - 1 : G_MAXUINT64;
+}
+
+
+
+static inline __m128i
+verve_fuzzy_in_range (__m128i chunk,
+                      gchar   first,
+                      gchar   last)
+{
+  /* Signed compares, bytes from 0x80 up are never in an ASCII range */
+  return _mm_and_si128 (_mm_cmpgt_epi8 (chunk, _mm_set1_epi8 (first - 1)),
+                        _mm_cmplt_epi8 (chunk, _mm_set1_epi8 (last + 1)));
+}
+
+
+
+static gint
+verve_fuzzy_score_bits (const gchar *pattern,
+                        gsize        pattern_len,
+                        const gchar *str,
+                        gsize        len)
+{
+  guchar   buffer[VERVE_FUZZY_BITS];
+  __m128i  folded[VERVE_FUZZY_BITS / 16];
+  guint64  positions[VERVE_FUZZY_BITS];
+  guint64  upper = 0;
+  guint64  lower = 0;
+  guint64  digit = 0;
+  guint64  alpha, alnum;
+  guint64  boundary, camel_case;
+  guint64  bits;
+  guint    n_blocks = (len + 15) / 16;
+  guint    pos, last;
+  guint    b;
+  gsize    j;
+  gint     score = 0;
+  gint     bonus;
+
+  /* Pad the string, so whole blocks can be loaded */
+  memcpy (buffer, str, len);
+  memset (buffer + len, 0, n_blocks * 16 - len);
+
+  /* Fold the case of all bytes, 16 at a time */
+  for (b = 0; b < n_blocks; b++)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) (buffer + 16 * b));
+      __m128i is_upper = verve_fuzzy_in_range (chunk, 'A', 'Z');
+
+      folded[b] = _mm_or_si128 (chunk, _mm_and_si128 (is_upper, _mm_set1_epi8 (0x20)));
+      upper |= (guint64) (guint) _mm_movemask_epi8 (is_upper) << (16 * b);
+    }
+
+  /* Find the end of the first occurrence of the pattern, computing the
+   * positions of each pattern character on the way */
+  for (j = 0, pos = 0; j < pattern_len; j++)
+    {
+      __m128i c = _mm_set1_epi8 (g_ascii_tolower (pattern[j]));
+
+      for (b = 0, bits = 0; b < n_blocks; b++)
+        bits |= (guint64) (guint) _mm_movemask_epi8 (_mm_cmpeq_epi8 (folded[b], c)) << (16 * b);
+
+      positions[j] = bits & verve_fuzzy_bits_below (len);
+
+      bits = positions[j] & verve_fuzzy_bits_from (pos);
+      if (bits == 0)
+        return VERVE_FUZZY_NO_MATCH;
+
+      pos = __builtin_ctzll (bits) + 1;
+    }
+
+  /* Walk back to the shortest window ending there, taking the last
+   * occurrence of each character before the one of the next */
+  for (j = pattern_len; j > 0; j--)
+    pos = 63 - __builtin_clzll (positions[j - 1] & verve_fuzzy_bits_below (pos));
+
+  /* Classify the bytes of strings which do match only */
+  for (b = 0; b < n_blocks; b++)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) (buffer + 16 * b));
+
+      lower |= (guint64) (guint) _mm_movemask_epi8 (verve_fuzzy_in_range (chunk, 'a', 'z')) << (16 * b);
+      digit |= (guint64) (guint) _mm_movemask_epi8 (verve_fuzzy_in_range (chunk, '0', '9')) << (16 * b);
+    }
+
+  /* Bonuses of all positions: word starts (and the start of the string),
+   * then camelCase and letters following digits */
+  alpha = upper | lower;
+  alnum = alpha | digit;
+  boundary = 1 | (alnum & ~(alnum << 1));
+  camel_case = (upper & (lower << 1)) | (alpha & (digit << 1));
+
+  /* Score the first occurrence inside the window */
+  for (j = 0, last = pos; j < pattern_len; j++)
+    {
+      if (j > 0)
+        pos = __builtin_ctzll (positions[j] & verve_fuzzy_bits_from (last + 1));
+
+      bonus = ((boundary >> pos) & 1) ? VERVE_FUZZY_BONUS_BOUNDARY
+            : ((camel_case >> pos) & 1) ? VERVE_FUZZY_BONUS_CAMEL_CASE : 0;
+
+      if (j == 0)
+        {
+          /* The first character counts twice */
+          bonus *= 2;
+        }
+      else if (pos == last + 1)
+        {
+          /* Continuing a run of matches is worth something, too */
+          bonus = MAX (bonus, VERVE_FUZZY_BONUS_CONSECUTIVE);
+        }
+      else
+        {
+          /* The first byte of a gap costs more than the others */
+          score -= VERVE_FUZZY_PENALTY_GAP_START + (gint) (pos - last - 2) * VERVE_FUZZY_PENALTY_GAP_EXTEND;
+        }
+
+      score += VERVE_FUZZY_SCORE_MATCH + bonus;
+      last = pos;
+    }
+
+  return score;
+}
+#endif
+
+
+
+gint
+verve_fuzzy_score (const gchar *pattern,
+                   gsize        pattern_len,
+                   const gchar *str,
+                   gsize        len)
+{
+  if (pattern_len == 0)
+    return 0;
+
+#if defined (__SSE2__)
+  /* Nearly all command names fit into the bit masks */
+  if (len <= VERVE_FUZZY_BITS)
+    return verve_fuzzy_score_bits (pattern, pattern_len, str, len);
+#endif
+
+  return verve_fuzzy_score_bytes (pattern, pattern_len, str, len);
+}
+
+
+
+static gboolean
+verve_fuzzy_match_is_worse (const VerveFuzzyMatch *a,
+                            const VerveFuzzyMatch *b)
+{
+  /* Lower scores, then longer strings, then later (bytewise) strings lose */
+  if (a->score != b->score)
+    return a->score < b->score;
+  if (a->length != b->length)
+    return a->length > b->length;
+
+  return a->index > b->index;
+}
+
+
+
+static void
+verve_fuzzy_heap_sift_down (VerveFuzzyMatch *heap,
+                            guint            n_matches,
+                            guint            i)
+{
+  VerveFuzzyMatch tmp;
+  guint           worst;
+
+  /* The worst match is kept at the root */
+  for (;;)
+    {
+      worst = i;
+
+      if (2 * i + 1 < n_matches && verve_fuzzy_match_is_worse (&heap[2 * i + 1], &heap[worst]))
+        worst = 2 * i + 1;
+      if (2 * i + 2 < n_matches && verve_fuzzy_match_is_worse (&heap[2 * i + 2], &heap[worst]))
+        worst = 2 * i + 2;
+
+      if (worst == i)
+        return;
+
+      tmp = heap[i];
+      heap[i] = heap[worst];
+      heap[worst] = tmp;
+      i = worst;
+    }
+}
+
+
+
+void
+verve_fuzzy_heap_push (VerveFuzzyMatch       *heap,
+                       guint                 *n_matches,
+                       guint                  max_matches,
+                       const VerveFuzzyMatch *match)
+{
+  VerveFuzzyMatch tmp;
+  guint           i;
+
+  if (*n_matches < max_matches)
+    {
+      /* Append the match and move it up to its place */
+      for (i = (*n_matches)++, heap[i] = *match;
+           i > 0 && verve_fuzzy_match_is_worse (&heap[i], &heap[(i - 1) / 2]);
+           i = (i - 1) / 2)
+        {
+          tmp = heap[i];
+          heap[i] = heap[(i - 1) / 2];
+          heap[(i - 1) / 2] = tmp;
+        }
+    }
+  else if (max_matches > 0 && verve_fuzzy_match_is_worse (&heap[0], match))
+    {
+      /* Replace the worst match kept so far */
+      heap[0] = *match;
+      verve_fuzzy_heap_sift_down (heap, *n_matches, 0);
+    }
+}
+
+
+
+void
+verve_fuzzy_heap_sort (VerveFuzzyMatch *heap,
+                       guint            n_matches)
+{
+  VerveFuzzyMatch tmp;
+
+  /* Repeatedly move the worst match to the end, leaving the best one first */
+  while (n_matches > 1)
+    {
+      tmp = heap[0];
+      heap[0] = heap[--n_matches];
+      heap[n_matches] = tmp;
+      verve_fuzzy_heap_sift_down (heap, n_matches, 0);
+    }
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,72 @@
+/***************************************************************************
+ *            verve-fuzzy.h
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __VERVE_FUZZY_H__
+#define __VERVE_FUZZY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS;
+
+/* Score of strings which don't contain the pattern */
+#define VERVE_FUZZY_NO_MATCH G_MININT
+
+typedef struct _VerveFuzzyKey   VerveFuzzyKey;
+typedef struct _VerveFuzzyMatch VerveFuzzyMatch;
+
+/* Precomputed data of a candidate string */
+struct _VerveFuzzyKey
+{
+  /* Character classes occurring in the string */
+  guint64 mask;
+  gsize   length;
+};
+
+/* Entry of the top-k heap */
+struct _VerveFuzzyMatch
+{
+  gint  score;
+  gsize length;
+  guint index;
+};
+
+void     verve_fuzzy_key_init  (VerveFuzzyKey   *key,
+                                const gchar     *str);
+gboolean verve_fuzzy_may_match (const VerveFuzzyKey *pattern,
+                                const VerveFuzzyKey *key);
+gint     verve_fuzzy_score     (const gchar     *pattern,
+                                gsize            pattern_len,
+                                const gchar     *str,
+                                gsize            len);
+
+void     verve_fuzzy_heap_push (VerveFuzzyMatch *heap,
+                                guint           *n_matches,
+                                guint            max_matches,
+                                const VerveFuzzyMatch *match);
+void     verve_fuzzy_heap_sort (VerveFuzzyMatch *heap,
+                                guint            n_matches);
+
+G_END_DECLS;
+
+#endif /* !__VERVE_FUZZY_H__ */
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,363 @@
+/***************************************************************************
+ *            verve-history-index.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include <string.h>
+
+#include "verve-history-index.h"
+
+
+
+/*********************************************************************
+ *
+ * History substring index
+ * -----------------------
+ *
+ * A suffix array over the history entries, which are stored oldest
+ * first in one block of text, each terminated by a NUL byte. All
+ * suffixes starting with a fragment form one range of the array, so
+ * finding the entries containing the fragment takes two binary
+ * searches, O(m log n) for a fragment of length m, plus one lookup per
+ * occurrence.
+ *
+ * Indexes are immutable. Since every suffix ends with its entry,
+ * appending entries does not change how the existing suffixes compare.
+ * A new index is therefore built in a worker thread by sorting only
+ * the suffixes of the added entries and merging them with those of the
+ * previous index, in linear time.
+ *
+ *********************************************************************/
+
+static void verve_history_index_extend_free   (gpointer      data);
+static void verve_history_index_extend_thread (GTask        *task,
+                                               gpointer      source_object,
+                                               gpointer      task_data,
+                                               GCancellable *cancellable);
+
+
+
+struct _VerveHistoryIndex
+{
+  gint     ref_count;
+
+  /* Entries, oldest first, each terminated by a NUL byte */
+  gchar   *text;
+  gsize    text_len;
+
+  /* Offsets of the entries in the text */
+  guint32 *starts;
+  guint    n_entries;
+
+  /* Offsets of the suffixes of all entries, in bytewise order */
+  guint32 *suffixes;
+  guint    n_suffixes;
+};
+
+
+
+/* Data of an extension running in the worker thread */
+typedef struct
+{
+  VerveHistoryIndex *index;
+
+  /* Added entries, each terminated by a NUL byte */
+  GString           *entries;
+} VerveHistoryIndexExtend;
+
+
+
+VerveHistoryIndex *
+verve_history_index_new (void)
+{
+  VerveHistoryIndex *index;
+
+  index = g_new0 (VerveHistoryIndex, 1);
+  index->ref_count = 1;
+
+  return index;
+}
+
+
+
+VerveHistoryIndex *
+verve_history_index_ref (VerveHistoryIndex *index)
+{
+  g_atomic_int_inc (&index->ref_count);
+
+  return index;
+}
+
+
+
+void
+verve_history_index_unref (VerveHistoryIndex *index)
+{
+  if (!g_atomic_int_dec_and_test (&index->ref_count))
+    return;
+
+  g_free (index->text);
+  g_free (index->starts);
+  g_free (index->suffixes);
+  g_free (index);
+}
+
+
+
+guint
+verve_history_index_get_n_entries (VerveHistoryIndex *index)
+{
+  return index->n_entries;
+}
+
+
+
+static gint
+verve_history_index_compare_entries (gconstpointer a,
+                                     gconstpointer b)
+{
+  guint ea = *(const guint *) a;
+  guint eb = *(const guint *) b;
+
+  /* Newest entries first */
+  return (ea < eb) - (ea > eb);
+}
+
+
+
+/* Replaces the contents of entries with the numbers of the entries
+ * (counted from the oldest one) containing fragment, newest first.
+ * Returns the number of entries found. */
+guint
+verve_history_index_find (VerveHistoryIndex *index,
+                          const gchar       *fragment,
+                          GArray            *entries)
+{
+  gsize len;
+  guint lo, hi, mid;
+  guint first, i, n;
+
+  g_array_set_size (entries, 0);
+
+  len = strlen (fragment);
+
+  if (len == 0)
+    return 0;
+
+  /* Lower bound: the first suffix not sorting before the fragment */
+  for (lo = 0, hi = index->n_suffixes; lo < hi; )
+    {
+      mid = lo + (hi - lo) / 2;
+      if (strcmp (index->text + index->suffixes[mid], fragment) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  first = lo;
+
+  /* Upper bound: the first suffix after that which does not start with the fragment */
+  for (hi = index->n_suffixes; lo < hi; )
+    {
+      mid = lo + (hi - lo) / 2;
+      if (strncmp (index->text + index->suffixes[mid], fragment, len) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  /* Map each occurrence to the entry containing it */
+  for (i = first; i < lo; i++)
+    {
+      guint32 offset = index->suffixes[i];
+      guint   l, h, m;
+
+      /* Find the last entry starting at or before the occurrence */
+      for (l = 0, h = index->n_entries; l < h; )
+        {
+          m = l + (h - l) / 2;
+          if (index->starts[m] <= offset)
+            l = m + 1;
+          else
+            h = m;
+        }
+
+      l--;
+      g_array_append_val (entries, l);
+    }
+
+  /* An entry may contain the fragment more than once */
+  g_array_sort (entries, verve_history_index_compare_entries);
+
+  for (i = 0, n = 0; i < entries->len; i++)
+    if (n == 0 || g_array_index (entries, guint, i) != g_array_index (entries, guint, n - 1))
+      g_array_index (entries, guint, n++) = g_array_index (entries, guint, i);
+
+  g_array_set_size (entries, n);
+
+  return n;
+}
+
+
+
+/* Builds a new index of the entries of index followed by the given ones
+ * in a worker thread. The index takes over the entries string. */
+void
+verve_history_index_extend_async (VerveHistoryIndex   *index,
+                                  GString             *entries,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+  VerveHistoryIndexExtend *extend;
+  GTask                   *task;
+
+  extend = g_new0 (VerveHistoryIndexExtend, 1);
+  extend->index = verve_history_index_ref (index);
+  extend->entries = entries;
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_task_data (task, extend, verve_history_index_extend_free);
+  g_task_run_in_thread (task, verve_history_index_extend_thread);
+  g_object_unref (task);
+}
+
+
+
+/* Returns the new index, or NULL if the extension was cancelled */
+VerveHistoryIndex *
+verve_history_index_extend_finish (GAsyncResult  *result,
+                                   GError       **error)
+{
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+
+
+static void
+verve_history_index_extend_free (gpointer data)
+{
+  VerveHistoryIndexExtend *extend = data;
+
+  verve_history_index_unref (extend->index);
+  g_string_free (extend->entries, TRUE);
+  g_free (extend);
+}
+
+
+
+static gint
+verve_history_index_compare_suffixes (gconstpointer a,
+                                      gconstpointer b,
+                                      gpointer      user_data)
+{
+  const gchar *text = user_data;
+
+  return strcmp (text + *(const guint32 *) a, text + *(const guint32 *) b);
+}
+
+
+
+static void
+verve_history_index_extend_thread (GTask        *task,
+                                   gpointer      source_object,
+                                   gpointer      task_data,
+                                   GCancellable *cancellable)
+{
+  VerveHistoryIndexExtend *extend = task_data;
+  VerveHistoryIndex       *old = extend->index;
+  VerveHistoryIndex       *index;
+  guint32                 *added;
+  gboolean                 entry_start = TRUE;
+  gsize                    offset;
+  guint                    n_added = 0;
+  guint                    i, j, k;
+
+  /* Offsets are stored in 32 bits */
+  if (G_UNLIKELY (old->text_len + extend->entries->len > G_MAXUINT32))
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "History index too large");
+      return;
+    }
+
+  index = verve_history_index_new ();
+
+  /* Append the entries to a copy of the text */
+  index->text_len = old->text_len + extend->entries->len;
+  index->text = g_malloc (index->text_len + 1);
+  memcpy (index->text, old->text, old->text_len);
+  memcpy (index->text + old->text_len, extend->entries->str, extend->entries->len);
+  index->text[index->text_len] = '\0';
+
+  /* There are at most as many new entries and suffixes as added bytes */
+  index->starts = g_new (guint32, old->n_entries + extend->entries->len);
+  memcpy (index->starts, old->starts, old->n_entries * sizeof (guint32));
+  index->n_entries = old->n_entries;
+
+  added = g_new (guint32, extend->entries->len + 1);
+
+  /* Collect the new entries and their suffixes, which start at whole UTF-8 characters */
+  for (offset = old->text_len; offset < index->text_len; offset++)
+    {
+      guchar c = index->text[offset];
+
+      if (entry_start)
+        index->starts[index->n_entries++] = offset;
+
+      if (c != '\0' && (c & 0xc0) != 0x80)
+        added[n_added++] = offset;
+
+      entry_start = (c == '\0');
+    }
+
+  /* Sort the new suffixes only */
+  g_qsort_with_data (added, n_added, sizeof (guint32), verve_history_index_compare_suffixes, index->text);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_free (added);
+      verve_history_index_unref (index);
+      return;
+    }
+
+  /* Merge them with the sorted suffixes of the previous index */
+  index->n_suffixes = old->n_suffixes + n_added;
+  index->suffixes = g_new (guint32, MAX (index->n_suffixes, 1));
+
+  for (i = 0, j = 0, k = 0; i < old->n_suffixes && j < n_added; k++)
+    {
+      if (strcmp (index->text + old->suffixes[i], index->text + added[j]) <= 0)
+        index->suffixes[k] = old->suffixes[i++];
+      else
+        index->suffixes[k] = added[j++];
+    }
+
+  memcpy (index->suffixes + k, old->suffixes + i, (old->n_suffixes - i) * sizeof (guint32));
+  k += old->n_suffixes - i;
+  memcpy (index->suffixes + k, added + j, (n_added - j) * sizeof (guint32));
+
+  g_free (added);
+
+  g_task_return_pointer (task, index, (GDestroyNotify) verve_history_index_unref);
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
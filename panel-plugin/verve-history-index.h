@@ -0,0 +1,54 @@
+/***************************************************************************
+ *            verve-history-index.h
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __VERVE_HISTORY_INDEX_H__
+#define __VERVE_HISTORY_INDEX_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS;
+
+typedef struct _VerveHistoryIndex VerveHistoryIndex;
+
+VerveHistoryIndex *verve_history_index_new           (void);
+VerveHistoryIndex *verve_history_index_ref           (VerveHistoryIndex    *index);
+void               verve_history_index_unref         (VerveHistoryIndex    *index);
+
+guint              verve_history_index_get_n_entries (VerveHistoryIndex    *index);
+guint              verve_history_index_find          (VerveHistoryIndex    *index,
+                                                      const gchar          *fragment,
+                                                      GArray               *entries);
+
+void               verve_history_index_extend_async  (VerveHistoryIndex    *index,
+                                                      GString              *entries,
+                                                      GCancellable         *cancellable,
+                                                      GAsyncReadyCallback   callback,
+                                                      gpointer              user_data);
+VerveHistoryIndex *verve_history_index_extend_finish (GAsyncResult         *result,
+                                                      GError              **error);
+
+G_END_DECLS;
+
+#endif /* !__VERVE_HISTORY_INDEX_H__ */
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -21,17 +21,117 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
 #include <libxfce4util/libxfce4util.h>
 
 #include "verve.h"
+#include "verve-arguments.h"
 #include "verve-history.h"
+#include "verve-history-index.h"
 
 
 
-const gchar *verve_history_cache_get_filename (void);
-static void  verve_history_cache_load         (void);
-static void  verve_history_cache_write        (void);
-static void  verve_history_append             (gchar *command);
+const gchar        *verve_history_cache_get_filename (void);
+static void         verve_history_cache_load         (GPtrArray    *commands);
+static const gchar *verve_history_lookup             (guint64       serial);
+static void         verve_history_store              (const gchar  *command);
+static void         verve_history_evict              (void);
+static void         verve_history_set_capacity       (guint         capacity);
+static void         verve_history_compact_pool       (void);
+static void         verve_history_journal_load       (void);
+static void         verve_history_journal_append     (const gchar  *command);
+static void         verve_history_journal_check      (void);
+static void         verve_history_compact_thread     (GTask        *task,
+                                                      gpointer      source_object,
+                                                      gpointer      task_data,
+                                                      GCancellable *cancellable);
+static void         verve_history_index_update       (void);
+static void         verve_history_index_extended     (GObject      *object,
+                                                      GAsyncResult *result,
+                                                      gpointer      user_data);
+
+
+
+/*********************************************************************
+ *
+ * History journal
+ * ---------------
+ *
+ * Commands are appended to the journal file as they are executed, one
+ * per line and oldest first, so a crash of the panel loses nothing and
+ * exiting does not have to write anything.
+ *
+ * Once the journal holds twice as many commands as are kept, it is
+ * compacted in a worker thread: the commands to keep are written to a
+ * temporary file, which then replaces the journal by renaming it.
+ * Commands executed in the meantime are still appended to the old
+ * journal, and also collected to be copied to the new file just before
+ * the rename. Both happen under the journal lock, so no command is lost
+ * and none is written twice.
+ *
+ *********************************************************************/
+
+/* Journals are compacted once they hold twice as many commands as are
+ * kept, but not before they hold this many */
+#define VERVE_HISTORY_JOURNAL_MIN_LINES 32
+
+
+
+/* Data of a compaction running in the worker thread */
+typedef struct
+{
+  gchar   *filename;
+
+  /* Commands to keep, oldest first, one per line */
+  GString *contents;
+  guint    n_lines;
+
+  /* Commands journaled during the compaction, protected by the journal lock */
+  GString *tail;
+  guint    n_tail;
+} VerveHistoryCompaction;
+
+
+
+/*********************************************************************
+ *
+ * History store
+ * -------------
+ *
+ * The kept commands are stored back to back in a string pool, and a
+ * ring buffer with room for as many commands as are kept holds their
+ * offsets. Every command is numbered when it is added, the command
+ * with serial number s has its offset in slot s % capacity. Adding a
+ * command, evicting the oldest one and looking one up by its position
+ * therefore take constant time.
+ *
+ * Evicted commands stay in the pool until they make up half of it, the
+ * pool is then compacted. A compaction copies no more bytes than were
+ * evicted since the previous one, so adding a command still takes
+ * constant time on average.
+ *
+ * Strings returned by the history point into the pool, so they are only
+ * valid until the next command is added.
+ *
+ *********************************************************************/
+
+/* Pool offsets of the kept commands, and the serial numbers of the
+ * oldest kept command and of the next command to be added */
+static guint32    *ring = NULL;
+static guint       ring_capacity = 0;
+static guint64     first_serial = 1;
+static guint64     next_serial = 1;
+
+/* Commands, NUL-terminated, and the number of bytes of evicted ones */
+static GByteArray *pool = NULL;
+static gsize       pool_garbage = 0;
 
 
 
@@ -41,15 +141,37 @@ static void  verve_history_append             (gchar *command);
  *
  *********************************************************************/
 
-static gint   history_length = 50;
-static GList *history = NULL;
+static gint history_length = 50;
 
+/* Substring index of the commands, its first entry has serial number
+ * index_base. A running extension starts the index at pending_base. */
+static VerveHistoryIndex *history_index = NULL;
+static guint64            index_base = 1;
+static guint64            pending_base = 1;
+static GCancellable      *index_cancellable = NULL;
 
+/* Journal file, the descriptor commands are appended to and the number
+ * of commands it holds. Shared with compactions, protected by the lock. */
+static GMutex                  journal_lock;
+static gchar                  *journal_filename = NULL;
+static gint                    journal_fd = -1;
+static guint                   journal_lines = 0;
+static VerveHistoryCompaction *compaction = NULL;
 
-void 
+
+
+void
 verve_history_init (void)
 {
-  verve_history_cache_load ();
+  pool = g_byte_array_new ();
+  first_serial = next_serial = 1;
+
+  verve_history_journal_load ();
+
+  /* Index the loaded commands in the background */
+  history_index = verve_history_index_new ();
+  index_base = first_serial;
+  verve_history_index_update ();
 }
 
 
@@ -57,23 +179,46 @@ verve_history_init (void)
 void
 verve_history_shutdown (void)
 {
-  /* Write history into the cache file */
-  verve_history_cache_write ();
+  /* Close the journal, every command has already been written to it. A
+   * running compaction still completes, it carries over all commands. */
+  g_mutex_lock (&journal_lock);
+
+  if (journal_fd >= 0)
+    {
+      close (journal_fd);
+      journal_fd = -1;
+    }
+
+  g_free (journal_filename);
+  journal_filename = NULL;
+
+  g_mutex_unlock (&journal_lock);
+
+  /* Stop indexing and drop the index */
+  if (index_cancellable != NULL)
+    {
+      g_cancellable_cancel (index_cancellable);
+      g_clear_object (&index_cancellable);
+    }
+
+  if (history_index != NULL)
+    {
+      verve_history_index_unref (history_index);
+      history_index = NULL;
+    }
 
   /* Free history data */
-  if (G_LIKELY (history != NULL))
+  if (G_LIKELY (pool != NULL))
     {
-      /* Free entries */
-      GList *iter = g_list_first (history);
-      while (iter != NULL)
-        {
-          g_free ((gchar *)iter->data);
-          iter = g_list_next (iter);
-        }
-      
-      /* Free list */
-      g_list_free (history);
+      g_byte_array_free (pool, TRUE);
+      pool = NULL;
+      pool_garbage = 0;
     }
+
+  g_free (ring);
+  ring = NULL;
+  ring_capacity = 0;
+  first_serial = next_serial = 1;
 }
 
 
@@ -82,60 +227,163 @@ void
 verve_history_set_length (gint length)
 {
   history_length = length;
+
+  /* Evict the commands which are not to be kept anymore */
+  if (G_LIKELY (pool != NULL))
+    {
+      verve_history_set_capacity (MAX (length, 0));
+      verve_history_index_update ();
+    }
+
+  /* The journal keeps them until it is compacted after the next command,
+   * so changing the setting alone never deletes saved history */
 }
 
 
 
 void
-verve_history_add (gchar *input)
+verve_history_add (const gchar *input)
 {
-  /* Prepend input to history */
-  history = g_list_prepend (history, input);
+  if (G_UNLIKELY (pool == NULL))
+    return;
+
+  /* Keep a copy of the command, evicting the oldest one if necessary */
+  verve_history_store (input);
+
+  /* Save the command right away */
+  if (history_length > 0)
+    verve_history_journal_append (input);
+
+  /* Learn the arguments used with the command */
+  verve_arguments_add (input);
+
+  /* Add the command to the substring index */
+  verve_history_index_update ();
+
+  /* Compact the journal if it grew too long */
+  verve_history_journal_check ();
 }
 
 
 
-void
-verve_history_append (gchar *command)
+static const gchar *
+verve_history_lookup (guint64 serial)
 {
-  /* Append command to history */
-  history = g_list_append (history, command);
+  /* Return the kept command with this serial number */
+  return (const gchar *) pool->data + ring[serial % ring_capacity];
 }
 
 
 
-GList*
-verve_history_begin (void)
+static void
+verve_history_store (const gchar *command)
 {
-  /* Return first list entry or NULL */
-  return g_list_first (history);
+  guint32 offset;
+
+  /* Nothing is kept */
+  if (G_UNLIKELY (ring_capacity == 0))
+    return;
+
+  /* Make room for the command if the ring is full */
+  if (next_serial - first_serial == ring_capacity)
+    verve_history_evict ();
+
+  /* Reclaim the space of evicted commands once they make up half the pool */
+  if (pool_garbage > 0 && pool_garbage >= pool->len / 2)
+    verve_history_compact_pool ();
+
+  /* Copy the command to the end of the pool */
+  offset = pool->len;
+  g_byte_array_append (pool, (const guint8 *) command, strlen (command) + 1);
+
+  ring[next_serial % ring_capacity] = offset;
+  next_serial++;
 }
 
 
 
-GList*
-verve_history_end (void)
+static void
+verve_history_evict (void)
 {
-  /* Return last list entry or NULL */
-  return g_list_last (history);
+  /* Drop the oldest command, its bytes are reclaimed by the next compaction */
+  pool_garbage += strlen (verve_history_lookup (first_serial)) + 1;
+  first_serial++;
 }
 
 
 
-GList*
-verve_history_get_prev (const GList *current)
+static void
+verve_history_set_capacity (guint capacity)
 {
-  /* Return command before the current one or NULL */
-  return g_list_previous (current);
+  guint32 *resized;
+  guint64  serial;
+
+  if (capacity == ring_capacity)
+    return;
+
+  /* Evict the oldest commands which don't fit anymore */
+  while (next_serial - first_serial > capacity)
+    verve_history_evict ();
+
+  /* Move the offsets to their slots in the resized ring */
+  resized = g_new (guint32, MAX (capacity, 1));
+  for (serial = first_serial; serial < next_serial; serial++)
+    resized[serial % capacity] = ring[serial % ring_capacity];
+
+  g_free (ring);
+  ring = resized;
+  ring_capacity = capacity;
+
+  if (pool_garbage > 0 && pool_garbage >= pool->len / 2)
+    verve_history_compact_pool ();
 }
 
 
 
-GList*
-verve_history_get_next (const GList *current)
+static void
+verve_history_compact_pool (void)
+{
+  GByteArray  *compacted;
+  const gchar *command;
+  guint64      serial;
+  gsize        length;
+
+  /* Copy the kept commands to a new pool, oldest first, and update their offsets */
+  compacted = g_byte_array_sized_new (pool->len - pool_garbage);
+
+  for (serial = first_serial; serial < next_serial; serial++)
+    {
+      command = verve_history_lookup (serial);
+      length = strlen (command) + 1;
+
+      ring[serial % ring_capacity] = compacted->len;
+      g_byte_array_append (compacted, (const guint8 *) command, length);
+    }
+
+  g_byte_array_free (pool, TRUE);
+  pool = compacted;
+  pool_garbage = 0;
+}
+
+
+
+guint
+verve_history_get_length (void)
+{
+  /* Return the number of kept commands */
+  return next_serial - first_serial;
+}
+
+
+
+const gchar *
+verve_history_get_nth (guint n)
 {
-  /* Return command after the current one or NULL */
-  return g_list_next (current);
+  /* Return the nth latest command or NULL */
+  if (G_UNLIKELY (n >= verve_history_get_length ()))
+    return NULL;
+
+  return verve_history_lookup (next_serial - 1 - n);
 }
 
 
@@ -143,11 +391,8 @@ verve_history_get_next (const GList *current)
 gboolean
 verve_history_is_empty (void)
 {
-  /* Check whether history is uninitialized or its length is zero */
-  if (G_UNLIKELY (history == NULL) || g_list_length (history) == 0)
-    return TRUE;
-  else
-    return FALSE;
+  /* Check whether no command is kept */
+  return next_serial == first_serial;
 }
 
 
@@ -155,17 +400,230 @@ verve_history_is_empty (void)
 const gchar*
 verve_history_get_last_command (void)
 {
-  /* Get first (= latest) history entry */
-  GList *list = verve_history_begin ();
-  
-  /* Return NULL if list is empty */
-  if (G_UNLIKELY (list == NULL))
+  /* Return the latest command or NULL */
+  return verve_history_get_nth (0);
+}
+
+
+
+gboolean
+verve_history_iter_init_latest (VerveHistoryIter *iter)
+{
+  /* Point to the latest command, if any */
+  iter->serial = (verve_history_is_empty () ? 0 : next_serial - 1);
+  return iter->serial != 0;
+}
+
+
+
+gboolean
+verve_history_iter_init_oldest (VerveHistoryIter *iter)
+{
+  /* Point to the oldest command, if any */
+  iter->serial = (verve_history_is_empty () ? 0 : first_serial);
+  return iter->serial != 0;
+}
+
+
+
+gboolean
+verve_history_iter_older (VerveHistoryIter *iter)
+{
+  /* Step to the command before the current one, or become invalid */
+  if (verve_history_iter_is_valid (iter) && iter->serial > first_serial)
+    iter->serial--;
+  else
+    iter->serial = 0;
+
+  return iter->serial != 0;
+}
+
+
+
+gboolean
+verve_history_iter_newer (VerveHistoryIter *iter)
+{
+  /* Step to the command after the current one, or become invalid */
+  if (verve_history_iter_is_valid (iter) && iter->serial + 1 < next_serial)
+    iter->serial++;
+  else
+    iter->serial = 0;
+
+  return iter->serial != 0;
+}
+
+
+
+gboolean
+verve_history_iter_is_valid (const VerveHistoryIter *iter)
+{
+  /* Serial numbers start at 1, so a zeroed iterator is never valid */
+  return iter->serial >= first_serial && iter->serial < next_serial;
+}
+
+
+
+const gchar *
+verve_history_iter_get_command (const VerveHistoryIter *iter)
+{
+  /* Return the command or NULL if it was evicted */
+  if (G_UNLIKELY (!verve_history_iter_is_valid (iter)))
     return NULL;
 
-  /* Return command data */
-  return (gchar *)list->data;
+  return verve_history_lookup (iter->serial);
+}
+
+
+
+void
+verve_history_iter_clear (VerveHistoryIter *iter)
+{
+  iter->serial = 0;
 }
-    
+
+
+
+static void
+verve_history_index_update (void)
+{
+  VerveHistoryIndex *index;
+  GString           *text;
+  guint64            serial;
+  guint              n_indexed;
+
+  /* One extension at a time, commands added meanwhile are indexed when it is done */
+  if (index_cancellable != NULL || G_UNLIKELY (history_index == NULL))
+    return;
+
+  n_indexed = verve_history_index_get_n_entries (history_index);
+
+  if (first_serial - index_base > n_indexed / 2)
+    {
+      /* Start over once half the indexed commands were evicted, so the index
+       * does not outgrow the history */
+      index = verve_history_index_new ();
+      pending_base = first_serial;
+      serial = first_serial;
+    }
+  else
+    {
+      /* Nothing to do if all commands are indexed */
+      serial = index_base + n_indexed;
+      if (serial == next_serial)
+        return;
+
+      index = verve_history_index_ref (history_index);
+      pending_base = index_base;
+    }
+
+  /* Copy the commands which are not indexed yet for the worker thread */
+  text = g_string_new (NULL);
+  for (; serial < next_serial; serial++)
+    g_string_append_len (text, verve_history_lookup (serial), strlen (verve_history_lookup (serial)) + 1);
+
+  index_cancellable = g_cancellable_new ();
+  verve_history_index_extend_async (index, text, index_cancellable, verve_history_index_extended, NULL);
+  verve_history_index_unref (index);
+}
+
+
+
+static void
+verve_history_index_extended (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  VerveHistoryIndex *index;
+  GError            *error = NULL;
+
+  index = verve_history_index_extend_finish (result, &error);
+
+  if (G_UNLIKELY (index == NULL))
+    {
+      /* The history was shut down in the meantime */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_error_free (error);
+          return;
+        }
+
+      g_warning ("Could not index the history: %s", error->message);
+      g_error_free (error);
+
+      /* Drop the index, searches scan the commands until the next one is
+       * added and indexing starts over */
+      g_clear_object (&index_cancellable);
+      verve_history_index_unref (history_index);
+      history_index = verve_history_index_new ();
+      index_base = first_serial;
+      return;
+    }
+
+  /* Replace the index */
+  g_clear_object (&index_cancellable);
+  verve_history_index_unref (history_index);
+  history_index = index;
+  index_base = pending_base;
+
+  /* Index the commands added in the meantime */
+  verve_history_index_update ();
+}
+
+
+
+/* Replaces the contents of results with the distinct commands containing
+ * fragment, most recent first. Returns the number of commands found. The
+ * commands are only valid until the next one is added. */
+guint
+verve_history_search (const gchar *fragment,
+                      GPtrArray   *results)
+{
+  GHashTable *seen;
+  GArray     *found;
+  guint64     serial;
+  guint64     unindexed;
+  guint       i;
+
+  g_ptr_array_set_size (results, 0);
+
+  if (G_UNLIKELY (history_index == NULL) || *fragment == '\0')
+    return 0;
+
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* The latest commands may not be indexed yet, scan them first */
+  unindexed = MAX (index_base + verve_history_index_get_n_entries (history_index), first_serial);
+  for (serial = next_serial; serial > unindexed; serial--)
+    {
+      gchar *command = (gchar *) verve_history_lookup (serial - 1);
+
+      if (strstr (command, fragment) != NULL && g_hash_table_add (seen, command))
+        g_ptr_array_add (results, command);
+    }
+
+  /* Look up the older ones in the index, skipping evicted commands */
+  found = g_array_new (FALSE, FALSE, sizeof (guint));
+  verve_history_index_find (history_index, fragment, found);
+
+  for (i = 0; i < found->len; i++)
+    {
+      gchar *command;
+
+      serial = index_base + g_array_index (found, guint, i);
+      if (serial < first_serial)
+        continue;
+
+      command = (gchar *) verve_history_lookup (serial);
+      if (g_hash_table_add (seen, command))
+        g_ptr_array_add (results, command);
+    }
+
+  g_array_free (found, TRUE);
+  g_hash_table_destroy (seen);
+
+  return results->len;
+}
+
 
 
 const gchar *
@@ -178,7 +636,7 @@ verve_history_cache_get_filename (void)
 
 
 static void
-verve_history_cache_load (void)
+verve_history_cache_load (GPtrArray *commands)
 {
   const gchar *basename = verve_history_cache_get_filename ();
 
@@ -216,7 +674,7 @@ verve_history_cache_load (void)
 
             /* Only add non-empty lines to the history */
             if (G_LIKELY (strline->len > 0))
-              verve_history_append (strline->str);
+              g_ptr_array_add (commands, strline->str);
 
             /* Free string data */
             g_free (line);
@@ -248,79 +706,237 @@ verve_history_cache_load (void)
 
 
 
+static gboolean
+verve_history_write_all (gint         fd,
+                         const gchar *data,
+                         gsize        length)
+{
+  gssize n;
+
+  /* Write everything, retrying after interruptions and partial writes */
+  while (length > 0)
+    {
+      n = write (fd, data, length);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (n <= 0)
+        return FALSE;
+
+      data += n;
+      length -= n;
+    }
+
+  return TRUE;
+}
+
+
+
 static void
-verve_history_cache_write (void)
+verve_history_journal_load (void)
 {
-  gchar *filename;
+  gchar     *contents;
+  gchar    **lines;
+  GPtrArray *commands;
+  GString   *migrated;
+  guint      i;
 
-  /* Do not write history if it is empty */
-  if (verve_history_is_empty ())
+  journal_filename = xfce_resource_save_location (XFCE_RESOURCE_CONFIG, "xfce4/Verve/history-journal", TRUE);
+
+  if (G_UNLIKELY (journal_filename == NULL))
     return;
 
-  /* Search for history file, create if it does not exist yet */
-  filename = xfce_resource_save_location (XFCE_RESOURCE_CONFIG,
-                                          verve_history_cache_get_filename (),
-                                          TRUE);
+  commands = g_ptr_array_new_with_free_func (g_free);
 
-  if (G_LIKELY (filename != NULL))
+  if (g_file_get_contents (journal_filename, &contents, NULL, NULL))
     {
-      GError     *error = NULL;
-      GIOChannel *handle;
-     
-      /* Open output stream */
-      handle = g_io_channel_new_file (filename, "w+", &error);
+      /* Collect the journaled commands, oldest first */
+      lines = g_strsplit (contents, "\n", -1);
+      g_free (contents);
 
-      /* Ignore and free error messages */
-      if (G_UNLIKELY (error != NULL))
-        g_error_free (error);
+      for (i = 0; lines[i] != NULL; i++)
+        {
+          gchar *line = g_strstrip (lines[i]);
 
-      /* Only write contents if stream could be opened */
-      if (G_LIKELY (handle != NULL))
-      {
-        GList    *current;
-        gsize     bytes;
-        int       i;
+          /* Only add non-empty lines to the history */
+          if (G_LIKELY (*line != '\0'))
+            g_ptr_array_add (commands, g_strdup (line));
+        }
 
-        /* Get first history entry */
-        current = verve_history_begin();
+      g_strfreev (lines);
 
-        /* Save the last 25 commands */
-        for (i = 0; i < history_length && current != NULL; i++)
-          {
-            /* Build output line */
-            gchar *line = g_strconcat ("", current->data, "\n", NULL);
+      /* Size the ring for all of them, the configured length is applied later */
+      verve_history_set_capacity (MAX ((guint) MAX (history_length, 0), commands->len));
 
-            /* Write line */
-            g_io_channel_write_chars (handle, line, -1, &bytes, &error);
+      for (i = 0; i < commands->len; i++)
+        verve_history_store (g_ptr_array_index (commands, i));
 
-            /* Free line string */
-            g_free (line);
-            
-            /* Do not write more records if there was an error (e.g. no space left on device) */
-            if (G_UNLIKELY (error != NULL))
-              {
-                g_error_free (error);
-                break;
-              }
-            
-            /* Step over to next entry */
-            current = verve_history_get_next (current);
-          }
+      journal_lines = commands->len;
+    }
+  else
+    {
+      /* Take over the history file written by earlier versions, latest command first */
+      verve_history_cache_load (commands);
+      verve_history_set_capacity (MAX ((guint) MAX (history_length, 0), commands->len));
 
-        /* Close file handle */
-        g_io_channel_shutdown (handle, TRUE, &error);
+      migrated = g_string_new (NULL);
+      for (i = commands->len; i > 0; i--)
+        {
+          verve_history_store (g_ptr_array_index (commands, i - 1));
 
-        /* Free error message */
-        if (G_UNLIKELY (error != NULL))
-          g_error_free (error);
+          g_string_append (migrated, g_ptr_array_index (commands, i - 1));
+          g_string_append_c (migrated, '\n');
+        }
 
-        /* Destroy stream object */
-        g_io_channel_unref (handle);
-      }
+      journal_lines = commands->len;
+
+      g_file_set_contents (journal_filename, migrated->str, migrated->len, NULL);
+      g_string_free (migrated, TRUE);
     }
-  
-  /* Free filename string */
-  g_free (filename);
+
+  g_ptr_array_free (commands, TRUE);
+
+  /* Open the journal for appending */
+  journal_fd = g_open (journal_filename, O_WRONLY | O_APPEND | O_CREAT, 0600);
+}
+
+
+
+static void
+verve_history_journal_append (const gchar *command)
+{
+  gchar *line;
+
+  line = g_strconcat (command, "\n", NULL);
+
+  g_mutex_lock (&journal_lock);
+
+  /* Append the command with a single write, so it is never torn by a crash */
+  if (G_LIKELY (journal_fd >= 0) && verve_history_write_all (journal_fd, line, strlen (line)))
+    journal_lines++;
+
+  /* A running compaction copies the command to the new journal */
+  if (compaction != NULL)
+    {
+      g_string_append (compaction->tail, line);
+      compaction->n_tail++;
+    }
+
+  g_mutex_unlock (&journal_lock);
+
+  g_free (line);
+}
+
+
+
+static void
+verve_history_journal_check (void)
+{
+  VerveHistoryCompaction *data;
+  GTask                  *task;
+  guint                   limit;
+  guint64                 serial;
+  guint                   n;
+  gboolean                busy;
+
+  if (G_UNLIKELY (journal_filename == NULL || pool == NULL))
+    return;
+
+  /* Compact once the journal holds twice as many commands as are kept */
+  limit = 2 * MAX ((guint) MAX (history_length, 0), VERVE_HISTORY_JOURNAL_MIN_LINES);
+
+  g_mutex_lock (&journal_lock);
+  busy = (compaction != NULL);
+  n = journal_lines;
+  g_mutex_unlock (&journal_lock);
+
+  if (busy || (n <= limit && (history_length > 0 || n == 0)))
+    return;
+
+  /* Collect the latest commands to keep, oldest first */
+  data = g_new0 (VerveHistoryCompaction, 1);
+  data->filename = g_strdup (journal_filename);
+  data->contents = g_string_new (NULL);
+  data->tail = g_string_new (NULL);
+
+  n = MIN ((guint) MAX (history_length, 0), verve_history_get_length ());
+  for (serial = next_serial - n; serial < next_serial; serial++)
+    {
+      g_string_append (data->contents, verve_history_lookup (serial));
+      g_string_append_c (data->contents, '\n');
+    }
+
+  data->n_lines = n;
+
+  g_mutex_lock (&journal_lock);
+  compaction = data;
+  g_mutex_unlock (&journal_lock);
+
+  /* Write the new journal in a worker thread */
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_task_data (task, data, NULL);
+  g_task_run_in_thread (task, verve_history_compact_thread);
+  g_object_unref (task);
+}
+
+
+
+static void
+verve_history_compact_thread (GTask        *task,
+                              gpointer      source_object,
+                              gpointer      task_data,
+                              GCancellable *cancellable)
+{
+  VerveHistoryCompaction *data = task_data;
+  gchar                  *temp_filename;
+  gboolean                success;
+  gint                    fd;
+
+  /* Write the commands to keep to a temporary file next to the journal */
+  temp_filename = g_strconcat (data->filename, ".tmp", NULL);
+  fd = g_open (temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+  success = (fd >= 0
+             && verve_history_write_all (fd, data->contents->str, data->contents->len)
+             && fsync (fd) == 0);
+
+  /* Appends wait from here on until the new journal is in place */
+  g_mutex_lock (&journal_lock);
+
+  /* Carry over the commands executed in the meantime */
+  if (success && data->tail->len > 0)
+    success = (verve_history_write_all (fd, data->tail->str, data->tail->len) && fsync (fd) == 0);
+
+  if (fd >= 0 && close (fd) != 0)
+    success = FALSE;
+
+  /* Atomically replace the journal */
+  if (success && g_rename (temp_filename, data->filename) == 0)
+    {
+      journal_lines = data->n_lines + data->n_tail;
+
+      /* Continue appending to the new journal, unless the history was shut down */
+      if (journal_fd >= 0)
+        {
+          close (journal_fd);
+          journal_fd = g_open (data->filename, O_WRONLY | O_APPEND | O_CREAT, 0600);
+        }
+    }
+  else
+    g_unlink (temp_filename);
+
+  compaction = NULL;
+
+  g_mutex_unlock (&journal_lock);
+
+  g_free (temp_filename);
+  g_free (data->filename);
+  g_string_free (data->contents, TRUE);
+  g_string_free (data->tail, TRUE);
+  g_free (data);
 }
 
+
+
 /* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -26,18 +26,35 @@
 
 #include <glib-object.h>
 
+/* Position of a command in the history, stays valid until the command
+ * is evicted. A zeroed iterator does not point to any command. */
+typedef struct
+{
+  /*< private >*/
+  guint64 serial;
+} VerveHistoryIter;
+
 /* Init / Shutdown history database */
-void         verve_history_init             (void);
-void         verve_history_shutdown         (void);
-
-void         verve_history_set_length       (gint         length);
-void         verve_history_add              (gchar       *input);
-GList       *verve_history_begin            (void);
-GList       *verve_history_end              (void);
-GList       *verve_history_get_prev         (const GList *current);
-GList       *verve_history_get_next         (const GList *current);
-gboolean     verve_history_is_empty         (void);
-const gchar *verve_history_get_last_command (void);
+void         verve_history_init              (void);
+void         verve_history_shutdown          (void);
+
+void         verve_history_set_length        (gint                    length);
+void         verve_history_add               (const gchar            *input);
+guint        verve_history_get_length        (void);
+const gchar *verve_history_get_nth           (guint                   n);
+gboolean     verve_history_is_empty          (void);
+const gchar *verve_history_get_last_command  (void);
+guint        verve_history_search            (const gchar            *fragment,
+                                              GPtrArray              *results);
+
+/* Browse the history */
+gboolean     verve_history_iter_init_latest  (VerveHistoryIter       *iter);
+gboolean     verve_history_iter_init_oldest  (VerveHistoryIter       *iter);
+gboolean     verve_history_iter_older        (VerveHistoryIter       *iter);
+gboolean     verve_history_iter_newer        (VerveHistoryIter       *iter);
+gboolean     verve_history_iter_is_valid     (const VerveHistoryIter *iter);
+const gchar *verve_history_iter_get_command  (const VerveHistoryIter *iter);
+void         verve_history_iter_clear        (VerveHistoryIter       *iter);
 
 #endif /* !__VERVE_HISTORY_H__ */
 
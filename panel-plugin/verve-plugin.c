@@ -37,9 +37,12 @@
 #include <libxfce4ui/libxfce4ui.h>
 
 #include "verve.h"
+#include "verve-arguments.h"
 #include "verve-env.h"
+#include "verve-frecency.h"
 #include "verve-history.h"
 #include "verve-completion.h"
+#include "verve-dir-cache.h"
 
 
 
@@ -58,66 +61,621 @@ typedef struct
   GtkCssProvider   *input_css;
   
   /* Command history */
-  GList            *history_current;
+  VerveHistoryIter  history_current;
+
+  /* Incremental reverse history search (Ctrl+R) */
+  gboolean          searching;
+  GString          *search_query;
+  gchar            *search_input;
+  GPtrArray        *search_matches;
+  GStringChunk     *search_strings;
+  guint             search_current;
 
   /* Timeouts */
   guint             focus_timeout;
   
   /* Autocompletion */
+  VerveEnv         *env;
   VerveCompletion  *completion;
+  GPtrArray        *results;
   guint             n_complete;
-  gchar            *last_prompt;
+  gint              prefix_len;
+  gboolean          completing;
+
+  /* Filename completion of arguments */
+  VerveDirCache    *dir_cache;
+  GCancellable     *dir_cancellable;
+  gboolean          dir_pending;
+  GStringChunk     *result_strings;
+  GStringChunk     *history_strings;
 
   /* Properties */ 
   GtkWidget        *settings_dialog;
   gint              size;
   gint              history_length;
+  gboolean          use_fuzzy;
   VerveLaunchParams launch_params;
 } VervePlugin;
 
 
-/* Mutex lock used to avoid thread collisions when accessing the command
- * completion 
- */
-G_LOCK_DEFINE_STATIC (plugin_completion_mutex);
+
+/* Maximum number of fuzzy completion results to cycle through */
+#define VERVE_PLUGIN_MAX_FUZZY_RESULTS 32
+
+/* Number of directory listings kept for filename completion */
+#define VERVE_PLUGIN_MAX_DIR_LISTINGS  16
+
+/* Maximum number of corrections offered for a mistyped command */
+#define VERVE_PLUGIN_MAX_SIMILAR_RESULTS 8
 
 
 static void
 verve_plugin_load_completion (VerveEnv* env, gpointer user_data)
+{
+  VervePlugin      *verve = (VervePlugin*) user_data;
+  VerveHistoryIter  iter;
+  GList            *items = NULL;
+  gboolean          valid;
+
+  /* Copy the history commands, the history reuses their memory once they are evicted */
+  for (valid = verve_history_iter_init_oldest (&iter); valid; valid = verve_history_iter_newer (&iter))
+    items = g_list_prepend (items, g_string_chunk_insert_const (verve->history_strings, verve_history_iter_get_command (&iter)));
+
+  /* The binaries from PATH were added batch by batch while loading, merge
+   * the history commands which are not among them into the completion */
+  verve_completion_merge_items (verve->completion, items);
+  g_list_free (items);
+}
+
+
+
+static gdouble
+verve_plugin_rank_item (gpointer item)
+{
+  /* Rank completion results by how often and how recently they were launched */
+  return verve_frecency_get (item);
+}
+
+
+
+static void
+verve_plugin_seed_completion (VervePlugin *verve)
+{
+  gpointer *names;
+  guint     n_binaries;
+  guint     i;
+
+  /* Take the binaries the environment knows already, e.g. because another
+   * instance of the plugin started loading them. Later batches arrive
+   * through "binaries-changed" */
+  n_binaries = verve_env_get_n_binaries (verve->env);
+  if (n_binaries == 0)
+    return;
+
+  /* They are sorted already and merged into the completion as they are */
+  names = g_new (gpointer, n_binaries);
+  for (i = 0; i < n_binaries; i++)
+    names[i] = (gpointer) verve_env_get_binary (verve->env, i, NULL);
+
+  verve_completion_merge_sorted_items (verve->completion, names, n_binaries);
+  g_free (names);
+}
+
+
+
+static GList *
+verve_plugin_strv_to_list (gchar **strv)
+{
+  GList *list = NULL;
+  guint  i;
+
+  /* Build a list of the (not copied) strings */
+  for (i = 0; strv != NULL && strv[i] != NULL; i++)
+    list = g_list_prepend (list, strv[i]);
+
+  return g_list_reverse (list);
+}
+
+
+
+static void
+verve_plugin_update_completion (VerveEnv *env,
+                                gchar   **added,
+                                gchar   **removed,
+                                gpointer  user_data)
 {
   VervePlugin *verve = (VervePlugin*) user_data;
+  GList       *items;
+
+  /* The results may refer to removed binaries, let the next Tab start over */
+  if (removed != NULL && removed[0] != NULL)
+    {
+      g_ptr_array_set_size (verve->results, 0);
+
+      /* Remove binaries which disappeared from $PATH */
+      items = verve_plugin_strv_to_list (removed);
+      verve_completion_remove_items (verve->completion, items);
+      g_list_free (items);
+    }
+
+  /* Merge new binaries as they are, the environment sorts them the way the
+   * completion does. The strings are owned by the environment */
+  if (added != NULL)
+    verve_completion_merge_sorted_items (verve->completion, (gpointer *) added, g_strv_length (added));
+}
 
-  /* Load command history */
-  GList *history = verve_history_begin ();
 
-  /* Load linux binaries from PATH */
-  GList *binaries = verve_env_get_path_binaries (env);
 
-  /* Merged (and sorted) list */
-  GList *items = NULL;
+static guint
+verve_plugin_complete_fuzzy (VervePlugin *verve,
+                             const gchar *pattern)
+{
+  guint n_results;
+
+  /* Let the fuzzy completion fill the result set directly */
+  g_ptr_array_set_size (verve->results, VERVE_PLUGIN_MAX_FUZZY_RESULTS);
+  n_results = verve_completion_complete_fuzzy (verve->completion, pattern, verve->results->pdata, VERVE_PLUGIN_MAX_FUZZY_RESULTS);
+  g_ptr_array_set_size (verve->results, n_results);
+
+  return n_results;
+}
 
-  /* Iterator */
-  GList *iter = NULL;
 
-  G_LOCK (plugin_completion_mutex);
 
-  /* Build merged list */
-  /* The list of binaries is already deduplicated */
-  items = g_list_copy (binaries);
-  for (iter = g_list_first (history); iter != NULL; iter = g_list_next (iter))
+static guint
+verve_plugin_complete_similar (VervePlugin *verve,
+                               const gchar *text)
+{
+  const gchar *arguments;
+  GString     *input;
+  gchar       *program;
+  guint        max_distance;
+  guint        n_results, n, i;
+
+  /* Split the input into the program and its arguments */
+  arguments = text + strcspn (text, " \t");
+  program = g_strndup (text, arguments - text);
+
+  /* Allow one typo in short names and two in longer ones, very short names are too ambiguous */
+  max_distance = (arguments - text < 3 ? 0 : (arguments - text < 5 ? 1 : 2));
+
+  /* Look up the commands within the allowed number of typos, closest first */
+  g_ptr_array_set_size (verve->results, VERVE_PLUGIN_MAX_SIMILAR_RESULTS);
+  n_results = (max_distance > 0 ? verve_completion_complete_similar (verve->completion, program, max_distance, verve->results->pdata, VERVE_PLUGIN_MAX_SIMILAR_RESULTS) : 0);
+
+  /* Replace the program by the corrections, keeping the arguments */
+  g_string_chunk_clear (verve->result_strings);
+  input = g_string_new (NULL);
+
+  for (i = 0, n = 0; i < n_results; i++)
     {
-      if (!g_list_find_custom (items, iter->data, (GCompareFunc) g_utf8_collate))
-        items = g_list_insert_sorted (items, iter->data, (GCompareFunc) g_utf8_collate);
+      const gchar *correction = g_ptr_array_index (verve->results, i);
+
+      /* Skip the program itself and history entries with arguments */
+      if (strcmp (correction, program) == 0 || correction[strcspn (correction, " \t")] != '\0')
+        continue;
+
+      g_string_assign (input, correction);
+      g_string_append (input, arguments);
+      g_ptr_array_index (verve->results, n++) = g_string_chunk_insert_len (verve->result_strings, input->str, input->len);
     }
 
-  /* Add merged items to completion */
-  if (G_LIKELY (history != NULL)) 
-    verve_completion_add_items (verve->completion, items);
+  g_ptr_array_set_size (verve->results, n);
 
-  /* Free merged list */
-  g_list_free (items);
-  
-  G_UNLOCK (plugin_completion_mutex);
+  g_string_free (input, TRUE);
+  g_free (program);
+
+  return n;
+}
+
+
+
+static void
+verve_plugin_show_result (VervePlugin *verve,
+                          GtkWidget   *entry)
+{
+  /* Put the result under the cursor into the input entry without ending the browsing session */
+  verve->completing = TRUE;
+  gtk_entry_set_text (GTK_ENTRY (entry), g_ptr_array_index (verve->results, verve->n_complete));
+  verve->completing = FALSE;
+
+  /* Select chars after the prefix entered by the user. Fuzzy results replace the whole input. */
+  if (verve->prefix_len >= 0)
+    gtk_editable_select_region (GTK_EDITABLE (entry), verve->prefix_len, -1);
+  else
+    gtk_editable_set_position (GTK_EDITABLE (entry), -1);
+}
+
+
+
+static guint
+verve_plugin_complete_history_arguments (VervePlugin *verve,
+                                         GtkWidget   *entry,
+                                         gboolean     backwards)
+{
+  const gchar *text;
+  const gchar *arguments;
+  GString     *input;
+  gchar       *program;
+  guint        n_results, i;
+
+  text = gtk_entry_get_text (GTK_ENTRY (entry));
+
+  /* Split the input into the program and the beginning of its arguments */
+  arguments = text + strcspn (text, " \t");
+  program = g_strndup (text, arguments - text);
+  arguments += strspn (arguments, " \t");
+
+  /* Get the arguments the program was used with before, best first */
+  n_results = verve_arguments_complete (program, arguments, verve->results);
+  g_free (program);
+
+  if (n_results == 0)
+    return 0;
+
+  /* Replace the arguments by the inputs they complete */
+  g_string_chunk_clear (verve->result_strings);
+  input = g_string_new_len (text, arguments - text);
+
+  for (i = 0; i < n_results; i++)
+    {
+      g_string_truncate (input, arguments - text);
+      g_string_append (input, g_ptr_array_index (verve->results, i));
+      g_ptr_array_index (verve->results, i) = g_string_chunk_insert_len (verve->result_strings, input->str, input->len);
+    }
+
+  g_string_free (input, TRUE);
+
+  /* Start browsing with the first (or the last) result */
+  verve->prefix_len = g_utf8_strlen (text, -1);
+  verve->n_complete = (backwards ? n_results - 1 : 0);
+  verve_plugin_show_result (verve, entry);
+
+  return n_results;
+}
+
+
+
+static void verve_plugin_dir_loaded (GObject      *object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data);
+
+
+
+static void
+verve_plugin_complete_argument (VervePlugin *verve,
+                                GtkWidget   *entry,
+                                gboolean     backwards)
+{
+  VerveDirListing *listing;
+  VerveCompletion *completion;
+  const gchar     *text;
+  const gchar     *word;
+  const gchar     *name;
+  GString         *input;
+  gchar           *directory;
+  gchar           *path;
+  gchar           *common_prefix;
+  gboolean         needs_check = FALSE;
+  gsize            len;
+  guint            n_results, n, i;
+
+  text = gtk_entry_get_text (GTK_ENTRY (entry));
+
+  /* The argument to complete is the last word of the input */
+  word = strrchr (text, ' ');
+  if (G_UNLIKELY (word == NULL))
+    return;
+  word++;
+
+  /* Split it into the directory and the beginning of the name */
+  name = strrchr (word, '/');
+  name = (name != NULL ? name + 1 : word);
+  directory = g_strndup (word, name - word);
+
+  /* Expand ~, relative paths start in the home directory like the commands */
+  if (directory[0] == '~' && directory[1] == '/')
+    path = g_build_filename (g_get_home_dir (), directory + 1, NULL);
+  else if (g_path_is_absolute (directory))
+    path = g_strdup (directory);
+  else
+    path = g_build_filename (g_get_home_dir (), directory, NULL);
+
+  g_free (directory);
+
+  /* Use the same cache key with and without a trailing slash */
+  len = strlen (path);
+  if (len > 1 && path[len - 1] == '/')
+    path[len - 1] = '\0';
+
+  /* Look up the directory listing, this never does any I/O */
+  listing = verve_dir_cache_lookup (verve->dir_cache, path, &needs_check);
+
+  /* List unknown directories in the background and complete once that is done.
+   * Known ones are checked for changes, but completed right away. */
+  if (listing == NULL || needs_check)
+    {
+      g_cancellable_cancel (verve->dir_cancellable);
+      g_object_unref (verve->dir_cancellable);
+      verve->dir_cancellable = g_cancellable_new ();
+
+      verve->dir_pending = (listing == NULL);
+      verve_dir_cache_load_async (verve->dir_cache, path, verve->dir_cancellable, verve_plugin_dir_loaded, verve);
+    }
+
+  g_free (path);
+
+  if (listing == NULL)
+    return;
+
+  completion = verve_dir_listing_get_completion (listing);
+
+  /* The input up to the name is kept as typed */
+  input = g_string_new_len (text, name - text);
+
+  /* Like a shell, first expand the name as far as all matching entries agree.
+   * This also completes a single match, after which Tab descends into it */
+  common_prefix = verve_completion_get_common_prefix (completion, name);
+
+  if (common_prefix != NULL && strlen (common_prefix) > strlen (name))
+    {
+      g_string_append (input, common_prefix);
+      gtk_entry_set_text (GTK_ENTRY (entry), input->str);
+      gtk_editable_set_position (GTK_EDITABLE (entry), -1);
+
+      g_free (common_prefix);
+      g_string_free (input, TRUE);
+
+      return;
+    }
+
+  g_free (common_prefix);
+
+  /* Replace the entry names by the inputs they complete, hidden entries
+   * are skipped unless the name starts with a dot */
+  n_results = verve_completion_complete_ranked (completion, name, verve->results);
+  g_string_chunk_clear (verve->result_strings);
+
+  for (i = 0, n = 0; i < n_results; i++)
+    {
+      const gchar *entry_name = g_ptr_array_index (verve->results, i);
+
+      if (entry_name[0] == '.' && name[0] != '.')
+        continue;
+
+      g_string_truncate (input, name - text);
+      g_string_append (input, entry_name);
+      g_ptr_array_index (verve->results, n++) = g_string_chunk_insert_len (verve->result_strings, input->str, input->len);
+    }
+
+  g_ptr_array_set_size (verve->results, n);
+  g_string_free (input, TRUE);
+
+  /* Start browsing with the first (or the last) result */
+  if (n > 0)
+    {
+      verve->prefix_len = g_utf8_strlen (text, -1);
+      verve->n_complete = (backwards ? n - 1 : 0);
+      verve_plugin_show_result (verve, entry);
+    }
+}
+
+
+
+static void
+verve_plugin_dir_loaded (GObject      *object,
+                         GAsyncResult *result,
+                         gpointer      user_data)
+{
+  VervePlugin     *verve = user_data;
+  VerveDirListing *listing;
+
+  /* Nothing to do if loading failed or was cancelled, the plugin may be gone in the latter case */
+  listing = verve_dir_cache_load_finish (result, NULL);
+  if (listing == NULL)
+    return;
+
+  verve_dir_cache_insert (verve->dir_cache, listing);
+
+  /* Complete the argument if the user is still waiting for it */
+  if (verve->dir_pending)
+    {
+      verve->dir_pending = FALSE;
+      verve_plugin_complete_argument (verve, verve->input, FALSE);
+    }
+}
+
+
+
+static void
+verve_plugin_input_changed (GtkEditable *editable,
+                            VervePlugin *verve)
+{
+  /* Any edit by the user ends browsing the completion results */
+  if (!verve->completing)
+    {
+      g_ptr_array_set_size (verve->results, 0);
+      verve->dir_pending = FALSE;
+    }
+}
+
+
+
+static void
+verve_plugin_search_show (VervePlugin *verve,
+                          GtkWidget   *entry)
+{
+  const gchar *query = verve->search_query->str;
+  const gchar *match;
+  gchar       *tooltip;
+  glong        start;
+
+  if (verve->search_matches->len > 0)
+    {
+      /* Put the current match into the input entry */
+      match = g_ptr_array_index (verve->search_matches, verve->search_current);
+      gtk_entry_set_text (GTK_ENTRY (entry), match);
+
+      /* Select the part of it matching the query */
+      start = g_utf8_pointer_to_offset (match, strstr (match, query));
+      gtk_editable_select_region (GTK_EDITABLE (entry), start, start + g_utf8_strlen (query, -1));
+
+      tooltip = g_strdup_printf (_("Reverse history search: %s"), query);
+    }
+  else if (*query != '\0')
+    {
+      /* Keep showing the last match, like readline does */
+      tooltip = g_strdup_printf (_("Failing reverse history search: %s"), query);
+      gtk_widget_error_bell (entry);
+    }
+  else
+    tooltip = g_strdup (_("Reverse history search"));
+
+  /* Show the query next to the entry */
+  gtk_widget_set_tooltip_text (entry, tooltip);
+  g_free (tooltip);
+}
+
+
+
+static void
+verve_plugin_search_update (VervePlugin *verve,
+                            GtkWidget   *entry)
+{
+  gchar *shown = NULL;
+  guint  i;
+
+  /* Remember the match shown so far */
+  if (verve->search_matches->len > 0)
+    shown = g_strdup (g_ptr_array_index (verve->search_matches, verve->search_current));
+
+  /* Look the query up in the history index, most recent commands first */
+  verve_history_search (verve->search_query->str, verve->search_matches);
+
+  /* Copy the matches, another instance may add to the history while they are browsed */
+  g_string_chunk_clear (verve->search_strings);
+  for (i = 0; i < verve->search_matches->len; i++)
+    g_ptr_array_index (verve->search_matches, i) = g_string_chunk_insert (verve->search_strings, g_ptr_array_index (verve->search_matches, i));
+
+  /* Stay at the shown match as long as it still matches */
+  verve->search_current = 0;
+  for (i = 0; shown != NULL && i < verve->search_matches->len; i++)
+    if (strcmp (g_ptr_array_index (verve->search_matches, i), shown) == 0)
+      {
+        verve->search_current = i;
+        break;
+      }
+
+  g_free (shown);
+
+  verve_plugin_search_show (verve, entry);
+}
+
+
+
+static void
+verve_plugin_search_start (VervePlugin *verve,
+                           GtkWidget   *entry)
+{
+  /* Remember the input to restore it if the search is cancelled */
+  g_free (verve->search_input);
+  verve->search_input = g_strdup (gtk_entry_get_text (GTK_ENTRY (entry)));
+
+  /* Begin with an empty query */
+  g_string_truncate (verve->search_query, 0);
+  g_ptr_array_set_size (verve->search_matches, 0);
+  verve->search_current = 0;
+  verve->searching = TRUE;
+
+  verve_plugin_search_show (verve, entry);
+}
+
+
+
+static void
+verve_plugin_search_end (VervePlugin *verve,
+                         GtkWidget   *entry,
+                         gboolean     restore)
+{
+  verve->searching = FALSE;
+  g_ptr_array_set_size (verve->search_matches, 0);
+  gtk_widget_set_tooltip_text (entry, NULL);
+
+  /* Either restore the input or keep the match for editing */
+  if (restore)
+    gtk_entry_set_text (GTK_ENTRY (entry), verve->search_input);
+  else
+    gtk_editable_set_position (GTK_EDITABLE (entry), -1);
+}
+
+
+
+static gboolean
+verve_plugin_search_keypress (VervePlugin *verve,
+                              GtkWidget   *entry,
+                              GdkEventKey *event)
+{
+  gunichar c;
+
+  switch (event->keyval)
+    {
+      /* Jump to the next older match */
+      case GDK_KEY_r:
+        if ((event->state & GDK_CONTROL_MASK) == 0)
+          break;
+
+        if (verve->search_current + 1 < verve->search_matches->len)
+          {
+            verve->search_current++;
+            verve_plugin_search_show (verve, entry);
+          }
+        else
+          gtk_widget_error_bell (entry);
+
+        return TRUE;
+
+      /* Cancel the search and restore the input */
+      case GDK_KEY_g:
+        if ((event->state & GDK_CONTROL_MASK) == 0)
+          break;
+        /* fall through */
+      case GDK_KEY_Escape:
+        verve_plugin_search_end (verve, entry, TRUE);
+        return TRUE;
+
+      /* Remove the last character from the query */
+      case GDK_KEY_BackSpace:
+        if (verve->search_query->len > 0)
+          {
+            gchar *last = g_utf8_find_prev_char (verve->search_query->str, verve->search_query->str + verve->search_query->len);
+
+            g_string_truncate (verve->search_query, last - verve->search_query->str);
+            verve_plugin_search_update (verve, entry);
+          }
+
+        return TRUE;
+
+      default:
+        break;
+    }
+
+  /* Add typed characters to the query */
+  c = gdk_keyval_to_unicode (event->keyval);
+  if (c != 0 && g_unichar_isprint (c) && (event->state & (GDK_CONTROL_MASK | GDK_MOD1_MASK)) == 0)
+    {
+      g_string_append_unichar (verve->search_query, c);
+      verve_plugin_search_update (verve, entry);
+      return TRUE;
+    }
+
+  /* Modifiers alone don't end the search */
+  if (event->is_modifier)
+    return TRUE;
+
+  /* Any other key accepts the match and is handled as usual */
+  verve_plugin_search_end (verve, entry, FALSE);
+
+  return FALSE;
 }
 
 
@@ -179,6 +737,10 @@ verve_plugin_focus_out (GtkWidget *entry,
   /* Stop blinking */
   verve_plugin_focus_timeout_reset (verve);
 
+  /* Keep the match of a reverse search running */
+  if (verve->searching)
+    verve_plugin_search_end (verve, entry, FALSE);
+
 #if !LIBXFCE4PANEL_CHECK_VERSION (4, 18, 5)
   /* Hide the panel again */
   xfce_panel_plugin_block_autohide (verve->plugin, FALSE);
@@ -223,11 +785,9 @@ verve_plugin_keypress_cb (GtkWidget   *entry,
   VerveCompletion *completion;
   gchar           *command;
   gboolean         terminal;
-  const gchar     *prefix;
-  GList           *similar = NULL;
-  gboolean         selected = FALSE;
-  gboolean         browsing_mode = FALSE;
-  gint             selstart, len;
+  const gchar     *text;
+  GList           *items;
+  guint            n_similar;
   guint            i;
 
   g_return_val_if_fail (verve != NULL, FALSE);
@@ -238,9 +798,21 @@ verve_plugin_keypress_cb (GtkWidget   *entry,
   /* Reset focus timeout, if necessary */
   if (verve->focus_timeout != 0)
     verve_plugin_focus_timeout_reset (verve);
+
+  /* Keys typed during a reverse history search edit its query */
+  if (verve->searching && verve_plugin_search_keypress (verve, entry, event))
+    return TRUE;
     
   switch (event->keyval)
     {
+      /* Start an incremental reverse search through the history */
+      case GDK_KEY_r:
+        if ((event->state & GDK_CONTROL_MASK) == 0)
+          return FALSE;
+
+        verve_plugin_search_start (verve, entry);
+        return TRUE;
+
       /* Reset entry value when ESC is pressed */
       case GDK_KEY_Escape:
          gtk_entry_set_text (GTK_ENTRY (entry), "");
@@ -253,36 +825,27 @@ verve_plugin_keypress_cb (GtkWidget   *entry,
           return TRUE;
 
         /* Check if we already are in "history browsing mode" */
-        if (G_LIKELY (verve->history_current != NULL))
+        if (G_LIKELY (verve_history_iter_is_valid (&verve->history_current)))
           {
-            /* Get entry before current */
-            GList *tmp = verve_history_get_prev (verve->history_current);
-            
-            /* Make sure we did not reach the end yet */
-            if (G_LIKELY (tmp != NULL))
+            /* Step to the newer entry, make sure we did not reach the end yet */
+            if (G_LIKELY (verve_history_iter_newer (&verve->history_current)))
               {
-                /* Set current entry */
-                verve->history_current = tmp;
-
                 /* Set verve input entry text */
-                gtk_entry_set_text (GTK_ENTRY (entry), verve->history_current->data);
+                gtk_entry_set_text (GTK_ENTRY (entry), verve_history_iter_get_command (&verve->history_current));
               }
             else
               {
-                /* Reset pointer to current history entry */
-                verve->history_current = NULL;
-
-                /* Clear verve input entry text */
+                /* The iterator was reset, clear verve input entry text */
                 gtk_entry_set_text (GTK_ENTRY (entry), "");
               }
           }
         else
           {
             /* Get last history entry */
-            verve->history_current = verve_history_end();
+            verve_history_iter_init_oldest (&verve->history_current);
 
             /* Set input entry text */
-            gtk_entry_set_text (GTK_ENTRY (entry), verve->history_current->data);
+            gtk_entry_set_text (GTK_ENTRY (entry), verve_history_iter_get_command (&verve->history_current));
           }
         
         return TRUE;
@@ -294,36 +857,27 @@ verve_plugin_keypress_cb (GtkWidget   *entry,
           return TRUE;
         
         /* Check whether we already are in history browsing mode */
-        if (G_LIKELY (verve->history_current != NULL))
+        if (G_LIKELY (verve_history_iter_is_valid (&verve->history_current)))
           {
-            /* Get command after current entry */
-            GList *tmp = verve_history_get_next (verve->history_current);
-
-            /* Make sure we did not reach the end yet */
-            if (G_LIKELY (tmp != NULL))
+            /* Step to the older command, make sure we did not reach the end yet */
+            if (G_LIKELY (verve_history_iter_older (&verve->history_current)))
               {
-                /* Set current history entry */
-                verve->history_current = tmp;
-
                 /* Set entry text */
-                gtk_entry_set_text (GTK_ENTRY (entry), verve->history_current->data);
+                gtk_entry_set_text (GTK_ENTRY (entry), verve_history_iter_get_command (&verve->history_current));
               }
             else
               {
-                /* Reset current history entry */
-                verve->history_current = NULL;
-
-                /* Clear entry text */
+                /* The iterator was reset, clear entry text */
                 gtk_entry_set_text (GTK_ENTRY (entry), "");
               }
           }
         else
           {
             /* Begin with latest history command */
-            verve->history_current = verve_history_begin ();
+            verve_history_iter_init_latest (&verve->history_current);
 
             /* Set entry text */
-            gtk_entry_set_text (GTK_ENTRY (entry), verve->history_current->data);
+            gtk_entry_set_text (GTK_ENTRY (entry), verve_history_iter_get_command (&verve->history_current));
           }
         
         return TRUE;
@@ -347,21 +901,19 @@ verve_plugin_keypress_cb (GtkWidget   *entry,
         if (G_LIKELY (verve_execute (command, terminal, verve->launch_params)))
           {
             /* Do not add command to history if it is the same as the one before */
-            if (verve_history_is_empty () || g_utf8_collate (verve_history_get_last_command (), command) != 0)
+            if (verve_history_is_empty () || strcmp (verve_history_get_last_command (), command) != 0)
               {
                 /* Add command to history */
-                verve_history_add (g_strdup (command));
-
-                G_LOCK (plugin_completion_mutex);
+                verve_history_add (command);
 
                 /* Add command to completion */
-                verve->completion->items = g_list_insert_sorted (verve->completion->items, g_strdup (command), (GCompareFunc) g_utf8_collate);
-
-                G_UNLOCK (plugin_completion_mutex);
+                items = g_list_prepend (NULL, g_strdup (command));
+                verve_completion_add_items (verve->completion, items);
+                g_list_free (items);
               }
       
             /* Reset current history entry */
-            verve->history_current = NULL;
+            verve_history_iter_clear (&verve->history_current);
 
             /* Clear input entry text */
             gtk_entry_set_text (GTK_ENTRY (entry), "");
@@ -369,13 +921,27 @@ verve_plugin_keypress_cb (GtkWidget   *entry,
         else
           {
             /* Generate error message */
-            gchar *msg = g_strconcat (_("Could not execute command:"), " ", command, NULL);
+            GString *msg = g_string_new (_("Could not execute command:"));
+            g_string_append_printf (msg, " %s", command);
+
+            /* Offer corrections if the command looks mistyped, pressing Enter again runs the closest one */
+            if (verve_plugin_complete_similar (verve, command) > 0)
+              {
+                g_string_append_printf (msg, "\n\n%s", _("Did you mean:"));
+                for (i = 0; i < verve->results->len; i++)
+                  g_string_append_printf (msg, "\n    %s", (const gchar *) g_ptr_array_index (verve->results, i));
+
+                /* Put the closest correction into the input entry, Tab cycles through the others */
+                verve->prefix_len = -1;
+                verve->n_complete = 0;
+                verve_plugin_show_result (verve, entry);
+              }
 
             /* Display error message dialog */
-            xfce_dialog_show_error (NULL, NULL, "%s", msg);
+            xfce_dialog_show_error (NULL, NULL, "%s", msg->str);
 
             /* Free message */
-            g_free (msg);
+            g_string_free (msg, TRUE);
           }
 
         /* Free entry text copy */
@@ -385,72 +951,99 @@ verve_plugin_keypress_cb (GtkWidget   *entry,
 
       /* Cycle through completion results */
       case GDK_KEY_Tab:
-        /* Retrieve a copy of the entry text */
-        command = g_strdup (gtk_entry_get_text (GTK_ENTRY (entry)));
+      case GDK_KEY_ISO_Left_Tab:
+        /* Browse the current result set as long as the input was not edited */
+        if (verve->results->len > 0)
+          {
+            /* Shift+Tab steps backwards, both directions wrap around */
+            if (event->keyval == GDK_KEY_ISO_Left_Tab)
+              verve->n_complete = (verve->n_complete + verve->results->len - 1) % verve->results->len;
+            else
+              verve->n_complete = (verve->n_complete + 1) % verve->results->len;
 
-        /* Determine command length and abort if it is empty */
-        if ((len = g_utf8_strlen (command, -1)) == 0)
+            verve_plugin_show_result (verve, entry);
+
+            return TRUE;
+          }
+
+        /* The entry text is what the user actually typed */
+        text = gtk_entry_get_text (GTK_ENTRY (entry));
+
+        /* Abort if it is empty */
+        if (*text == '\0')
           return TRUE;
 
-        /* Determine currently selected chars */
-        selected = gtk_editable_get_selection_bounds (GTK_EDITABLE (entry), &selstart, NULL);
+        /* Remember the prefix length, it stays unselected while browsing */
+        verve->prefix_len = g_utf8_strlen (text, -1);
 
-        /* Check if we are in auto-completion browsing mode */
-        browsing_mode = ((selstart != 0 && selected) || (g_strcmp0 (verve->last_prompt, command) == 0 && !selected));
+        /* After a known command, offer the arguments it was used with before */
+        if (strchr (text, ' ') != NULL
+            && verve_plugin_complete_history_arguments (verve, entry, event->keyval == GDK_KEY_ISO_Left_Tab) > 0)
+          return TRUE;
 
-        if (browsing_mode)
-          {
-            /* Switch over to the next completion result */
-            verve->n_complete++;
+        /* Get the completion results, most frecently launched commands first */
+        n_similar = verve_completion_complete_ranked (completion, text, verve->results);
 
-            /* Determine the prefix (which is what the user actually typed by himself) */
-            prefix = g_strndup (command, selstart);
-          }
-        else
+        /* Like a shell, first expand the input to the prefix shared by all results */
+        if (n_similar > 1)
           {
-            /* Start with first completion result */
-            verve->n_complete = 0;
+            gchar *common_prefix = verve_completion_get_common_prefix (completion, text);
 
-            /* The complete input is the prefix */
-            prefix = command;
-          }
+            if (common_prefix != NULL && strlen (common_prefix) > strlen (text))
+              {
+                /* Put the common prefix into the input entry, the next Tab cycles through the results */
+                g_ptr_array_set_size (verve->results, 0);
+                gtk_entry_set_text (GTK_ENTRY (entry), common_prefix);
+                gtk_editable_set_position (GTK_EDITABLE (entry), -1);
 
-        G_LOCK (plugin_completion_mutex);
+                g_free (common_prefix);
 
-        /* Get all completion results */
-        similar = verve_completion_complete (completion, prefix);
+                return TRUE;
+              }
 
-        G_UNLOCK (plugin_completion_mutex);
+            g_free (common_prefix);
+          }
 
-        /* Check if there are any results */
-        if (G_LIKELY (similar != NULL))
+        /* Nothing in the history starts with the command line, complete the filename of its last argument */
+        if (n_similar == 0 && strchr (text, ' ') != NULL)
           {
-            /* Check if we are in browsing mode already */
-            if (browsing_mode)
-              {
-                /* Go back to the first entry if we reached the end of the result list */
-                if (verve->n_complete >= g_list_length (similar))
-                  verve->n_complete = 0;
-
-                /* Search the next result */
-                for (i = 0; i < verve->n_complete; i++)
-                  if (similar->next != NULL)
-                    similar = similar->next;
-              }
+            verve_plugin_complete_argument (verve, entry, event->keyval == GDK_KEY_ISO_Left_Tab);
+            return TRUE;
+          }
 
-            /* Put result text into input entry */
-            gtk_entry_set_text (GTK_ENTRY (entry), similar->data);
+        /* No command starts with the input, look for history commands containing it */
+        if (n_similar == 0)
+          {
+            n_similar = verve_history_search (text, verve->results);
+            verve->prefix_len = -1;
 
-            g_free (verve->last_prompt);
-            verve->last_prompt = g_strdup (similar->data);
+            /* Copy the matches, another instance may add to the history while they are browsed */
+            g_string_chunk_clear (verve->result_strings);
+            for (i = 0; i < n_similar; i++)
+              g_ptr_array_index (verve->results, i) = g_string_chunk_insert (verve->result_strings, g_ptr_array_index (verve->results, i));
+          }
 
-            /* Select chars after the prefix entered by the user */
-            gtk_editable_select_region (GTK_EDITABLE (entry), (selstart == 0 ? len : selstart), -1);
+        /* Look for commands containing the characters of the input */
+        if (n_similar == 0 && verve->use_fuzzy)
+          {
+            n_similar = verve_plugin_complete_fuzzy (verve, text);
+            verve->prefix_len = -1;
+          }
+
+        /* Nothing matches at all, the command may be mistyped */
+        if (n_similar == 0)
+          {
+            n_similar = verve_plugin_complete_similar (verve, text);
+            verve->prefix_len = -1;
+          }
+
+        /* Start browsing with the first (or, for Shift+Tab, the last) result */
+        if (G_LIKELY (n_similar > 0))
+          {
+            verve->n_complete = (event->keyval == GDK_KEY_ISO_Left_Tab ? n_similar - 1 : 0);
+            verve_plugin_show_result (verve, entry);
           }
 
-        /* Free entry text copy */
-        g_free (command);
- 
         return TRUE;
 
       /* Any other key pressed, so the entry will handle the input itself */
@@ -477,10 +1070,25 @@ verve_plugin_new (XfcePanelPlugin *plugin)
   verve->plugin = plugin;
   
   /* Initialize completion variables */
-  verve->history_current = NULL;
+  verve_history_iter_clear (&verve->history_current);
   verve->completion = verve_completion_new (NULL);
+  verve_completion_set_rank_func (verve->completion, verve_plugin_rank_item);
+  verve->results = g_ptr_array_new ();
   verve->n_complete = 0;
-  verve->last_prompt = g_strdup ("");
+  verve->prefix_len = 0;
+  verve->completing = FALSE;
+  verve->dir_cache = verve_dir_cache_new (VERVE_PLUGIN_MAX_DIR_LISTINGS);
+  verve->dir_cancellable = g_cancellable_new ();
+  verve->dir_pending = FALSE;
+  verve->result_strings = g_string_chunk_new (1024);
+  verve->history_strings = g_string_chunk_new (1024);
+  verve->searching = FALSE;
+  verve->search_query = g_string_new (NULL);
+  verve->search_input = NULL;
+  verve->search_matches = g_ptr_array_new ();
+  verve->search_strings = g_string_chunk_new (1024);
+  verve->search_current = 0;
+  verve->use_fuzzy = FALSE;
   verve->size = 20;
   verve->history_length = 25;
   verve->launch_params.use_bang = FALSE;
@@ -496,8 +1104,17 @@ verve_plugin_new (XfcePanelPlugin *plugin)
   /* Initialize label */
   verve->label = gtk_label_new ("");
 
+  /* Get the environment, the reference is dropped in verve_shutdown () */
+  verve->env = verve_env_get ();
+
+  /* Start with the binaries loaded so far */
+  verve_plugin_seed_completion (verve);
+
   /* Connect to load-binaries signal of environment */
-  g_signal_connect (G_OBJECT (verve_env_get()), "load-binaries", G_CALLBACK (verve_plugin_load_completion), verve);
+  g_signal_connect (G_OBJECT (verve->env), "load-binaries", G_CALLBACK (verve_plugin_load_completion), verve);
+
+  /* Connect to binaries-changed signal to follow changes in $PATH */
+  g_signal_connect (G_OBJECT (verve->env), "binaries-changed", G_CALLBACK (verve_plugin_update_completion), verve);
 
   /* Initialize focus timeout */
   verve->focus_timeout = 0;
@@ -530,6 +1147,9 @@ verve_plugin_new (XfcePanelPlugin *plugin)
   g_signal_connect (verve->input, "button-press-event", G_CALLBACK (verve_plugin_buttonpress_cb), verve);
   g_signal_connect (verve->input, "focus-in-event", G_CALLBACK (verve_plugin_focus_in), verve);
   g_signal_connect (verve->input, "focus-out-event", G_CALLBACK (verve_plugin_focus_out), verve);
+
+  /* End browsing the completion results whenever the input is edited */
+  g_signal_connect (verve->input, "changed", G_CALLBACK (verve_plugin_input_changed), verve);
   
   return verve;
 }
@@ -543,8 +1163,25 @@ verve_plugin_free (XfcePanelPlugin *plugin,
   /* Unregister focus timeout */
   verve_plugin_focus_timeout_reset (verve);
 
+  /* Stop listening to the environment */
+  g_signal_handlers_disconnect_by_data (verve->env, verve);
+
   /* Unload completion */
   verve_completion_free (verve->completion);
+  g_ptr_array_free (verve->results, TRUE);
+
+  /* Stop listing directories, the callback won't touch the plugin anymore */
+  g_cancellable_cancel (verve->dir_cancellable);
+  g_object_unref (verve->dir_cancellable);
+  verve_dir_cache_free (verve->dir_cache);
+  g_string_chunk_free (verve->result_strings);
+  g_string_chunk_free (verve->history_strings);
+
+  /* Free reverse search data */
+  g_string_free (verve->search_query, TRUE);
+  g_free (verve->search_input);
+  g_ptr_array_free (verve->search_matches, TRUE);
+  g_string_chunk_free (verve->search_strings);
 
   /* Free plugin data structure */
   g_free (verve);
@@ -767,6 +1404,9 @@ verve_plugin_read_rc_file (XfcePanelPlugin *plugin,
       /* Read number of saved history entries */
       history_length = xfce_rc_read_int_entry (rc, "history-length", history_length);
 
+      /* Read whether to fall back to fuzzy completion */
+      verve->use_fuzzy = xfce_rc_read_bool_entry (rc, "use-fuzzy", verve->use_fuzzy);
+
       /* Read launch parameters */
       verve->launch_params.use_url = xfce_rc_read_bool_entry (rc, "use-url", verve->launch_params.use_url);
       verve->launch_params.use_email = xfce_rc_read_bool_entry (rc, "use-email", verve->launch_params.use_email);
@@ -779,6 +1419,11 @@ verve_plugin_read_rc_file (XfcePanelPlugin *plugin,
 
       /* Read smartbookmark URL */
       smartbookmark_url = xfce_rc_read_entry (rc, "smartbookmark-url", smartbookmark_url);
+
+      /* Read time to wait for loading $PATH binaries on shutdown, in milliseconds
+       * (hidden option, useful with slow network mounts in $PATH) */
+      if (xfce_rc_has_entry (rc, "shutdown-timeout"))
+        verve_env_set_shutdown_timeout (verve->env, MAX (xfce_rc_read_int_entry (rc, "shutdown-timeout", 0), 0));
     
       /* Update plugin size */
       verve_plugin_update_size (NULL, size, verve);
@@ -836,6 +1481,9 @@ verve_plugin_write_rc_file (XfcePanelPlugin *plugin,
       /* Write number of saved history entries */
       xfce_rc_write_int_entry (rc, "history-length", verve->history_length);
 
+      /* Write fuzzy completion setting */
+      xfce_rc_write_bool_entry (rc, "use-fuzzy", verve->use_fuzzy);
+
       /* Write launch param settings */
       xfce_rc_write_bool_entry (rc, "use-url", verve->launch_params.use_url);
       xfce_rc_write_bool_entry (rc, "use-email", verve->launch_params.use_email);
@@ -934,8 +1582,19 @@ verve_plugin_history_length_changed (GtkSpinButton *spin,
 {
   g_return_if_fail (verve != NULL);
 
-  /* Update history length */
-  verve_plugin_update_history_length (NULL, gtk_spin_button_get_value_as_int (spin), verve);
+  /* Remember the history length, it is applied when the dialog is closed
+   * so values passed while typing or spinning don't evict commands */
+  verve->history_length = gtk_spin_button_get_value_as_int (spin);
+}
+
+
+
+static void
+verve_plugin_use_fuzzy_changed (GtkToggleButton *button, 
+                                VervePlugin     *verve)
+{
+  g_return_if_fail (verve != NULL);
+  verve->use_fuzzy = gtk_toggle_button_get_active (button);
 }
 
 
@@ -1045,6 +1704,9 @@ verve_plugin_response (GtkWidget *dialog,
 
   /* Destroy dialog object */
   gtk_widget_destroy (dialog);
+
+  /* Apply the history length chosen in the dialog */
+  verve_plugin_update_history_length (NULL, verve->history_length, verve);
   
   /* Save changes to config file */
   verve_plugin_write_rc_file (verve->plugin, verve);
@@ -1076,6 +1738,7 @@ verve_plugin_properties (XfcePanelPlugin *plugin,
   GtkWidget *label_box;
   GtkWidget *history_length_label;
   GtkWidget *history_length_spin;
+  GtkWidget *use_fuzzy;
   GtkAdjustment *adjustment;
 
   GtkWidget *bin3;
@@ -1273,7 +1936,7 @@ verve_plugin_properties (XfcePanelPlugin *plugin,
   gtk_widget_show (history_length_label);
 
   /* History length adjustment */
-  adjustment = gtk_adjustment_new (verve->history_length, 0, 1000, 1, 5, 0);
+  adjustment = gtk_adjustment_new (verve->history_length, 0, 10000, 1, 5, 0);
 
   /* History length spin button */
   history_length_spin = gtk_spin_button_new (GTK_ADJUSTMENT (adjustment), 1, 0);
@@ -1286,6 +1949,14 @@ verve_plugin_properties (XfcePanelPlugin *plugin,
 
   /* Be notified when the user requests a different history length */
   g_signal_connect (history_length_spin, "value-changed", G_CALLBACK (verve_plugin_history_length_changed), verve);
+
+  /* Fuzzy completion checkbox */
+  use_fuzzy = gtk_check_button_new_with_label (_("Complete fuzzily if no command starts with the input"));
+  gtk_box_pack_start (GTK_BOX (vbox), use_fuzzy, FALSE, TRUE, 0);
+  gtk_widget_show (use_fuzzy);
+
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (use_fuzzy), verve->use_fuzzy);
+  g_signal_connect (use_fuzzy, "toggled", G_CALLBACK (verve_plugin_use_fuzzy_changed), verve);
   
   /* Second tab */
   frame = xfce_gtk_frame_box_new (_("Behaviour"), &bin3);
@@ -0,0 +1,464 @@
+/***************************************************************************
+ *            verve-trie.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "verve-trie.h"
+
+
+
+/*********************************************************************
+ *
+ * Radix trie
+ * ----------
+ *
+ * A compressed trie of completion strings. Every node is reached by a
+ * non-empty edge label, chains of nodes with a single child and no
+ * string of their own are merged, and subtrees without strings are
+ * dropped. Finding the longest common prefix of the strings with a
+ * given prefix therefore only takes a walk down the prefix.
+ *
+ * Strings within a few edits of a word are found by running a
+ * Levenshtein automaton of the word along the edges of the trie. Its
+ * state is shared by all strings below a node, and subtrees are left
+ * as soon as no state of the automaton is active anymore, so only a
+ * small part of the trie is ever visited.
+ *
+ *********************************************************************/
+
+/* Most edits verve_trie_find_similar () allows */
+#define VERVE_TRIE_MAX_DISTANCE 3
+
+typedef struct _VerveTrieNode VerveTrieNode;
+
+struct _VerveTrieNode
+{
+  /* Label of the edge leading to this node */
+  gchar         *label;
+  gsize          label_len;
+
+  /* Number of strings ending at this node */
+  guint          n_items;
+
+  /* Children, sorted by the first byte of their labels */
+  VerveTrieNode *children;
+  VerveTrieNode *next;
+};
+
+
+
+struct _VerveTrie
+{
+  /* The root node has an empty label */
+  VerveTrieNode root;
+};
+
+
+
+/* Levenshtein automaton of a word, simulated bit-parallel: bit i of
+ * states[d] is set when the first i bytes of the word match the input
+ * read so far with at most d edits */
+typedef struct
+{
+  /* Bit i + 1 is set in the mask of the byte at position i of the word */
+  guint64              masks[256];
+
+  /* Bits of the positions 0 ... length of the word */
+  guint64              positions;
+  gsize                length;
+  guint                max_distance;
+
+  /* Key of the node being visited */
+  GString             *key;
+
+  VerveTrieSimilarFunc func;
+  gpointer             user_data;
+} VerveTrieSimilar;
+
+
+
+VerveTrie *
+verve_trie_new (void)
+{
+  return g_new0 (VerveTrie, 1);
+}
+
+
+
+static void
+verve_trie_node_free (VerveTrieNode *node)
+{
+  VerveTrieNode *child;
+  VerveTrieNode *next;
+
+  for (child = node->children; child != NULL; child = next)
+    {
+      next = child->next;
+      verve_trie_node_free (child);
+    }
+
+  g_free (node->label);
+  g_free (node);
+}
+
+
+
+void
+verve_trie_free (VerveTrie *trie)
+{
+  VerveTrieNode *child;
+  VerveTrieNode *next;
+
+  if (trie == NULL)
+    return;
+
+  for (child = trie->root.children; child != NULL; child = next)
+    {
+      next = child->next;
+      verve_trie_node_free (child);
+    }
+
+  g_free (trie);
+}
+
+
+
+static VerveTrieNode **
+verve_trie_node_find_child (VerveTrieNode *node,
+                            gchar          c)
+{
+  VerveTrieNode **link;
+
+  /* Return the link where a child starting with c is or would have to be */
+  for (link = &node->children; *link != NULL && (guchar) (*link)->label[0] < (guchar) c; link = &(*link)->next)
+    ;
+
+  return link;
+}
+
+
+
+void
+verve_trie_insert (VerveTrie   *trie,
+                   const gchar *key)
+{
+  VerveTrieNode  *node = &trie->root;
+  VerveTrieNode **link;
+  VerveTrieNode  *child;
+  gsize           n;
+
+  for (;;)
+    {
+      /* The key ends at this node */
+      if (*key == '\0')
+        {
+          node->n_items++;
+          return;
+        }
+
+      link = verve_trie_node_find_child (node, *key);
+      child = *link;
+
+      /* No edge starts with this character, add a leaf with the rest of the key */
+      if (child == NULL || child->label[0] != *key)
+        {
+          child = g_new0 (VerveTrieNode, 1);
+          child->label_len = strlen (key);
+          child->label = g_strndup (key, child->label_len);
+          child->n_items = 1;
+          child->next = *link;
+          *link = child;
+          return;
+        }
+
+      /* Determine how much of the edge label matches */
+      for (n = 1; n < child->label_len && child->label[n] == key[n]; n++)
+        ;
+
+      /* Split the edge if the key leaves it halfway */
+      if (n < child->label_len)
+        {
+          VerveTrieNode *split = g_new0 (VerveTrieNode, 1);
+          gchar         *label = child->label;
+
+          split->label = g_strndup (label, n);
+          split->label_len = n;
+          split->children = child;
+          split->next = child->next;
+          *link = split;
+
+          child->label = g_strndup (label + n, child->label_len - n);
+          child->label_len -= n;
+          child->next = NULL;
+          g_free (label);
+
+          child = split;
+        }
+
+      key += n;
+      node = child;
+    }
+}
+
+
+
+static gboolean
+verve_trie_node_remove (VerveTrieNode *node,
+                        const gchar   *key)
+{
+  VerveTrieNode **link;
+  VerveTrieNode  *child;
+
+  /* The key ends at this node */
+  if (*key == '\0')
+    {
+      if (node->n_items == 0)
+        return FALSE;
+
+      node->n_items--;
+      return TRUE;
+    }
+
+  /* Follow the edge matching the key */
+  link = verve_trie_node_find_child (node, *key);
+  child = *link;
+
+  if (child == NULL || strncmp (child->label, key, child->label_len) != 0)
+    return FALSE;
+
+  if (!verve_trie_node_remove (child, key + child->label_len))
+    return FALSE;
+
+  if (child->n_items == 0 && child->children == NULL)
+    {
+      /* Drop the empty subtree */
+      *link = child->next;
+      verve_trie_node_free (child);
+    }
+  else if (child->n_items == 0 && child->children->next == NULL)
+    {
+      VerveTrieNode *grandchild = child->children;
+      gchar         *label = grandchild->label;
+
+      /* Merge the child with its only child to keep the trie compressed */
+      grandchild->label = g_strconcat (child->label, label, NULL);
+      grandchild->label_len += child->label_len;
+      grandchild->next = child->next;
+      *link = grandchild;
+      g_free (label);
+
+      child->children = NULL;
+      verve_trie_node_free (child);
+    }
+
+  return TRUE;
+}
+
+
+
+gboolean
+verve_trie_remove (VerveTrie   *trie,
+                   const gchar *key)
+{
+  return verve_trie_node_remove (&trie->root, key);
+}
+
+
+
+static VerveTrieNode *
+verve_trie_lookup (VerveTrie   *trie,
+                   const gchar *prefix,
+                   gsize       *offset)
+{
+  VerveTrieNode *node = &trie->root;
+  VerveTrieNode *child;
+  gsize          n = 0;
+
+  /* Walk down the prefix, it may end in the middle of an edge label */
+  while (*prefix != '\0')
+    {
+      child = *verve_trie_node_find_child (node, *prefix);
+
+      if (child == NULL || child->label[0] != *prefix)
+        return NULL;
+
+      for (n = 1; n < child->label_len && prefix[n] != '\0'; n++)
+        if (child->label[n] != prefix[n])
+          return NULL;
+
+      prefix += n;
+      node = child;
+    }
+
+  /* Number of label bytes covered by the prefix */
+  *offset = n;
+
+  return node;
+}
+
+
+
+gchar *
+verve_trie_common_prefix (VerveTrie   *trie,
+                          const gchar *prefix)
+{
+  VerveTrieNode *node;
+  GString       *result;
+  gsize          offset;
+
+  node = verve_trie_lookup (trie, prefix, &offset);
+
+  /* No string starts with this prefix, only the root can be empty */
+  if (node == NULL || (node->n_items == 0 && node->children == NULL))
+    return NULL;
+
+  /* The rest of the edge label is shared by all strings below */
+  result = g_string_new (prefix);
+  g_string_append_len (result, node->label + offset, node->label_len - offset);
+
+  /* Follow the path as long as it does not branch or end */
+  while (node->n_items == 0 && node->children != NULL && node->children->next == NULL)
+    {
+      node = node->children;
+      g_string_append_len (result, node->label, node->label_len);
+    }
+
+  return g_string_free (result, FALSE);
+}
+
+
+
+static gboolean
+verve_trie_similar_step (const VerveTrieSimilar *similar,
+                         guint64                *states,
+                         guchar                  c)
+{
+  guint64 match = similar->masks[c];
+  guint64 previous = states[0];
+  guint64 old;
+  guint   d;
+
+  /* Without edits the byte has to be the next one of the word */
+  states[0] = (states[0] << 1) & match;
+
+  for (d = 1; d <= similar->max_distance; d++)
+    {
+      old = states[d];
+
+      /* Match the byte, insert it, substitute it, or delete a byte of the word */
+      states[d] = (((old << 1) & match) | previous | (previous << 1) | (states[d - 1] << 1)) & similar->positions;
+
+      previous = old;
+    }
+
+  /* The states with fewer edits are contained in the last one */
+  return states[similar->max_distance] != 0;
+}
+
+
+
+static void
+verve_trie_node_find_similar (VerveTrieSimilar    *similar,
+                              const VerveTrieNode *node,
+                              const guint64       *parent_states)
+{
+  const VerveTrieNode *child;
+  guint64              states[VERVE_TRIE_MAX_DISTANCE + 1];
+  gsize                key_len = similar->key->len;
+  gsize                i;
+  guint                d;
+
+  memcpy (states, parent_states, sizeof (states));
+
+  /* Feed the edge label to the automaton, skip the subtree once it gets stuck */
+  for (i = 0; i < node->label_len; i++)
+    if (!verve_trie_similar_step (similar, states, node->label[i]))
+      return;
+
+  g_string_append_len (similar->key, node->label, node->label_len);
+
+  /* Report a string ending here if the whole word was matched */
+  if (node->n_items > 0)
+    for (d = 0; d <= similar->max_distance; d++)
+      if (states[d] & ((guint64) 1 << similar->length))
+        {
+          similar->func (similar->key->str, d, similar->user_data);
+          break;
+        }
+
+  for (child = node->children; child != NULL; child = child->next)
+    verve_trie_node_find_similar (similar, child, states);
+
+  g_string_truncate (similar->key, key_len);
+}
+
+
+
+/* Calls func for every string which can be turned into word by at most
+ * max_distance byte insertions, deletions and substitutions, along with
+ * the smallest number of edits needed. The strings are passed in bytewise
+ * order. */
+void
+verve_trie_find_similar (VerveTrie            *trie,
+                         const gchar          *word,
+                         guint                 max_distance,
+                         VerveTrieSimilarFunc  func,
+                         gpointer              user_data)
+{
+  VerveTrieSimilar similar;
+  guint64          states[VERVE_TRIE_MAX_DISTANCE + 1];
+  gsize            i;
+  guint            d;
+
+  g_return_if_fail (trie != NULL);
+  g_return_if_fail (word != NULL);
+  g_return_if_fail (func != NULL);
+
+  memset (similar.masks, 0, sizeof (similar.masks));
+  similar.length = strlen (word);
+
+  /* The positions of the word have to fit into the state bits */
+  if (similar.length > VERVE_TRIE_MAX_SIMILAR_LENGTH)
+    return;
+
+  for (i = 0; i < similar.length; i++)
+    similar.masks[(guchar) word[i]] |= (guint64) 1 << (i + 1);
+
+  similar.positions = (similar.length < 63 ? ((guint64) 1 << (similar.length + 1)) - 1 : G_MAXUINT64);
+  similar.max_distance = MIN (max_distance, VERVE_TRIE_MAX_DISTANCE);
+  similar.key = g_string_new (NULL);
+  similar.func = func;
+  similar.user_data = user_data;
+
+  /* Initially up to d bytes at the beginning of the word may be deleted */
+  memset (states, 0, sizeof (states));
+  for (d = 0; d <= similar.max_distance; d++)
+    states[d] = (((guint64) 2 << d) - 1) & similar.positions;
+
+  verve_trie_node_find_similar (&similar, &trie->root, states);
+
+  g_string_free (similar.key, TRUE);
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *            verve-trie.h
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __VERVE_TRIE_H__
+#define __VERVE_TRIE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS;
+
+/* Longest word verve_trie_find_similar () accepts, in bytes */
+#define VERVE_TRIE_MAX_SIMILAR_LENGTH 63
+
+typedef struct _VerveTrie VerveTrie;
+
+typedef void (*VerveTrieSimilarFunc) (const gchar *key,
+                                      guint        distance,
+                                      gpointer     user_data);
+
+VerveTrie *verve_trie_new           (void);
+void       verve_trie_free          (VerveTrie            *trie);
+
+void       verve_trie_insert        (VerveTrie            *trie,
+                                     const gchar          *key);
+gboolean   verve_trie_remove        (VerveTrie            *trie,
+                                     const gchar          *key);
+
+gchar     *verve_trie_common_prefix (VerveTrie            *trie,
+                                     const gchar          *prefix);
+void       verve_trie_find_similar  (VerveTrie            *trie,
+                                     const gchar          *word,
+                                     guint                 max_distance,
+                                     VerveTrieSimilarFunc  func,
+                                     gpointer              user_data);
+
+G_END_DECLS;
+
+#endif /* !__VERVE_TRIE_H__ */
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */
@@ -34,7 +34,9 @@
 #include <libxfce4ui/libxfce4ui.h>
 
 #include "verve.h"
+#include "verve-arguments.h"
 #include "verve-env.h"
+#include "verve-frecency.h"
 #include "verve-history.h"
 
 
@@ -71,6 +73,12 @@ verve_init (void)
 {
   /* Init history database */
   verve_history_init ();
+
+  /* Open launch statistics */
+  verve_frecency_init ();
+
+  /* Load the arguments used with commands, learned from the history if necessary */
+  verve_arguments_init ();
 }
 
 
@@ -81,6 +89,12 @@ verve_shutdown (void)
   /* Free history database */
   verve_history_shutdown ();
 
+  /* Close launch statistics */
+  verve_frecency_shutdown ();
+
+  /* Save the arguments used with commands */
+  verve_arguments_shutdown ();
+
   /* Shutdown environment */
   verve_env_shutdown ();
 }
@@ -234,6 +248,10 @@ verve_execute (const gchar *input,
   /* Try to execute the xfce-open command */
   if (verve_spawn_command_line (command))
     result = TRUE;
+
+  /* Rank the input higher in completion results */
+  if (result)
+    verve_frecency_add (input);
     
   /* Free command string */
   g_free (command);
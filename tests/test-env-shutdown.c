@@ -0,0 +1,193 @@
+/***************************************************************************
+ *            test-env-shutdown.c
+ *
+ *  Copyright  2026  The Xfce development team
+ ****************************************************************************/
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "verve-env-private.h"
+
+
+
+/* Time the loading thread is waited for on shutdown, in milliseconds */
+#define TEST_SHUTDOWN_TIMEOUT 100
+
+/* Time the scanners stall when the loading thread is to be detached, in milliseconds */
+#define TEST_STALL            2000
+
+/* Extra time allowed for a slow machine, in milliseconds */
+#define TEST_SLACK            1000
+
+
+
+static void test_env_remove_tree        (const gchar *path);
+static void test_env_weak_notify        (gpointer     data,
+                                         GObject     *where_the_object_was);
+static void test_env_shutdown_joined    (void);
+static void test_env_shutdown_detached  (void);
+
+
+
+/* Set once the environment is finalized, possibly by the loading thread */
+static gint finalized = 0;
+
+
+
+static void
+test_env_remove_tree (const gchar *path)
+{
+  const gchar *name;
+  GDir        *dir;
+  gchar       *child;
+
+  /* Remove the contents of directories first */
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          child = g_build_filename (path, name, NULL);
+          test_env_remove_tree (child);
+          g_free (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
+}
+
+
+
+static void
+test_env_weak_notify (gpointer  data,
+                      GObject  *where_the_object_was)
+{
+  g_atomic_int_set (&finalized, 1);
+}
+
+
+
+static void
+test_env_shutdown_joined (void)
+{
+  VerveEnv *env;
+
+  verve_env_test_set_stall (0);
+  g_atomic_int_set (&finalized, 0);
+
+  env = verve_env_get ();
+  g_object_weak_ref (G_OBJECT (env), test_env_weak_notify, NULL);
+
+  /* Give the thread plenty of time, it is joined and releases the environment */
+  verve_env_set_shutdown_timeout (env, TEST_STALL);
+  verve_env_shutdown ();
+
+  g_assert_cmpint (g_atomic_int_get (&finalized), ==, 1);
+}
+
+
+
+static void
+test_env_shutdown_detached (void)
+{
+  VerveEnv *env;
+  gint64    start;
+  gint64    elapsed;
+  gint64    deadline;
+
+  verve_env_test_set_stall (TEST_STALL);
+  g_atomic_int_set (&finalized, 0);
+
+  env = verve_env_get ();
+  g_object_weak_ref (G_OBJECT (env), test_env_weak_notify, NULL);
+  verve_env_set_shutdown_timeout (env, TEST_SHUTDOWN_TIMEOUT);
+
+  /* Detaching the thread is reported with a warning, which is expected here */
+  g_log_set_always_fatal (G_LOG_FATAL_MASK | G_LOG_LEVEL_CRITICAL);
+
+  /* Shutdown must return once the timeout expired, while the scanners still stall */
+  start = g_get_monotonic_time ();
+  verve_env_shutdown ();
+  elapsed = (g_get_monotonic_time () - start) / G_TIME_SPAN_MILLISECOND;
+
+  g_assert_cmpint (elapsed, >=, TEST_SHUTDOWN_TIMEOUT);
+  g_assert_cmpint (elapsed, <, TEST_SHUTDOWN_TIMEOUT + TEST_SLACK);
+
+  /* The detached thread still holds its reference */
+  g_assert_cmpint (g_atomic_int_get (&finalized), ==, 0);
+
+  /* It finalizes the environment once the scanners return */
+  deadline = g_get_monotonic_time () + (TEST_STALL + 5 * TEST_SLACK) * G_TIME_SPAN_MILLISECOND;
+  while (g_atomic_int_get (&finalized) == 0 && g_get_monotonic_time () < deadline)
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+
+  g_assert_cmpint (g_atomic_int_get (&finalized), ==, 1);
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  gchar *root;
+  gchar *bin;
+  gchar *cache;
+  gchar *binary;
+  gint   result;
+
+  g_test_init (&argc, &argv, NULL);
+
+  /* Scan a private $PATH directory and keep the cache out of the user's home */
+  root = g_dir_make_tmp ("verve-test-XXXXXX", NULL);
+  g_assert_nonnull (root);
+
+  bin = g_build_filename (root, "bin", NULL);
+  cache = g_build_filename (root, "cache", NULL);
+  binary = g_build_filename (bin, "verve-test-binary", NULL);
+
+  g_assert_cmpint (g_mkdir (bin, 0755), ==, 0);
+  g_assert_cmpint (g_mkdir (cache, 0755), ==, 0);
+  g_assert_true (g_file_set_contents (binary, "#!/bin/sh\n", -1, NULL));
+  g_assert_cmpint (g_chmod (binary, 0755), ==, 0);
+
+  g_setenv ("PATH", bin, TRUE);
+  g_setenv ("XDG_CACHE_HOME", cache, TRUE);
+
+  g_test_add_func ("/env/shutdown/joined", test_env_shutdown_joined);
+  g_test_add_func ("/env/shutdown/detached", test_env_shutdown_detached);
+
+  result = g_test_run ();
+
+  test_env_remove_tree (root);
+
+  g_free (binary);
+  g_free (cache);
+  g_free (bin);
+  g_free (root);
+
+  return result;
+}
+
+
+
+/* vim:set expandtab sts=2 ts=2 sw=2: */